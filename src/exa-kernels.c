@@ -0,0 +1,667 @@
+/* Pixel kernels for the software EXA implementation
+ * Copyright 2008 Kalle Vahlman, <zuh@iki.fi>
+ *
+ * Permission to use, copy, modify, distribute and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the names of the authors and/or copyright holders
+ * not be used in advertising or publicity pertaining to distribution of the
+ * software without specific, written prior permission.  The authors and
+ * copyright holders make no representations about the suitability of this
+ * software for any purpose.  It is provided "as is" without any express
+ * or implied warranty.
+ *
+ * THE AUTHORS AND COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * This file contains the pixel loops behind the software EXA hooks.
+ *
+ * The destination is usually the framebuffer, which is mapped uncached
+ * and write-combined, so the loops write whole aligned bursts wherever
+ * possible and avoid reading back from it.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "exa-kernels.h"
+
+/* x * a / 255, rounded */
+#define MUL_UN8(x, a, t) \
+	((t) = (x) * (a) + 0x80, (((t) >> 8) + (t)) >> 8)
+
+#define PACK_0565(r, g, b) \
+	((((r) & 0xf8) << 8) | (((g) & 0xfc) << 3) | ((b) >> 3))
+
+static inline uint16_t over_pixel_8888_0565(uint32_t s, uint16_t d)
+{
+	uint32_t a = s >> 24;
+	uint32_t r, g, b, t;
+
+	if (a == 0xff)
+		return PACK_0565((s >> 16) & 0xff, (s >> 8) & 0xff, s & 0xff);
+
+	/* Expand the destination to 8 bits per channel */
+	r = (d >> 8) & 0xf8;
+	r |= r >> 5;
+	g = (d >> 3) & 0xfc;
+	g |= g >> 6;
+	b = (d << 3) & 0xf8;
+	b |= b >> 5;
+
+	a = 0xff - a;
+	r = ((s >> 16) & 0xff) + MUL_UN8(r, a, t);
+	g = ((s >> 8) & 0xff) + MUL_UN8(g, a, t);
+	b = (s & 0xff) + MUL_UN8(b, a, t);
+
+	/* Saturate, source is not necessarily a valid premultiplied value */
+	r = r > 0xff ? 0xff : r;
+	g = g > 0xff ? 0xff : g;
+	b = b > 0xff ? 0xff : b;
+
+	return PACK_0565(r, g, b);
+}
+
+static void over_line_8888_0565(uint16_t *dest, uint32_t *src, int w)
+{
+	while (w--)
+	{
+		uint32_t s = *src++;
+
+		if (s >> 24)
+			*dest = over_pixel_8888_0565(s, *dest);
+		dest++;
+	}
+}
+
+static void over_n_8_line_0565(uint16_t *dest, uint8_t *mask, uint32_t src, int w)
+{
+	while (w--)
+	{
+		uint32_t m = *mask++;
+		uint32_t a, r, g, b, t;
+
+		if (m == 0xff)
+		{
+			*dest = over_pixel_8888_0565(src, *dest);
+		}
+		else if (m)
+		{
+			a = MUL_UN8(src >> 24, m, t);
+			r = MUL_UN8((src >> 16) & 0xff, m, t);
+			g = MUL_UN8((src >> 8) & 0xff, m, t);
+			b = MUL_UN8(src & 0xff, m, t);
+			*dest = over_pixel_8888_0565((a << 24) | (r << 16) | (g << 8) | b,
+			                             *dest);
+		}
+		dest++;
+	}
+}
+
+static void add_line_8_8(uint8_t *dest, uint8_t *src, int w)
+{
+	while (w--)
+	{
+		unsigned int v = *dest + *src++;
+
+		*dest++ = v > 0xff ? 0xff : v;
+	}
+}
+
+static void convert_line_8888_0565(uint16_t *dest, uint32_t *src, int w)
+{
+	while (w--)
+	{
+		uint32_t s = *src++;
+
+		*dest++ = PACK_0565((s >> 16) & 0xff, (s >> 8) & 0xff, s & 0xff);
+	}
+}
+
+static void convert_line_0565_8888(uint32_t *dest, uint16_t *src, int w)
+{
+	while (w--)
+	{
+		uint32_t d = *src++;
+		uint32_t r = (d >> 8) & 0xf8;
+		uint32_t g = (d >> 3) & 0xfc;
+		uint32_t b = (d << 3) & 0xf8;
+
+		*dest++ = 0xff000000 | ((r | (r >> 5)) << 16)
+		        | ((g | (g >> 6)) << 8) | (b | (b >> 5));
+	}
+}
+
+#ifndef HAVE_NEON
+
+/* Fill n 32-bit words starting at a 16-byte aligned address */
+static void fill_words(uint32_t *dest, int n, uint32_t value)
+{
+	while (n >= 8)
+	{
+		dest[0] = value;
+		dest[1] = value;
+		dest[2] = value;
+		dest[3] = value;
+		dest[4] = value;
+		dest[5] = value;
+		dest[6] = value;
+		dest[7] = value;
+		dest += 8;
+		n -= 8;
+	}
+
+	while (n--)
+		*dest++ = value;
+}
+
+/* memmove already picks a safe direction for overlapping lines */
+static void copy_line_forward(uint8_t *dest, uint8_t *src, int len)
+{
+	memmove(dest, src, len);
+}
+
+static void copy_line_backward(uint8_t *dest, uint8_t *src, int len)
+{
+	memmove(dest, src, len);
+}
+
+/* The C build composites each line a pixel at a time */
+#define over_span_8888_0565 over_line_8888_0565
+#define over_n_8_span_0565 over_n_8_line_0565
+#define add_span_8_8 add_line_8_8
+#define convert_span_8888_0565 convert_line_8888_0565
+#define convert_span_0565_8888 convert_line_0565_8888
+
+static void readback_line(uint8_t *dest, uint8_t *src, int len)
+{
+	memcpy(dest, src, len);
+}
+
+#endif /* ! HAVE_NEON */
+
+#ifdef HAVE_NEON
+
+static void fill_words(uint32_t *dest, int n, uint32_t value)
+{
+	if (n >= 8)
+	{
+		int bursts = n & ~7;
+
+		// avoid using d8-d15 (q4-q7) aapcs callee-save registers
+		asm volatile (
+			"vdup.32   q0, %[value]\n\t"
+			"vmov      q1, q0\n\t"
+			"1:\n\t"
+			"subs      %[bursts],%[bursts],#8\n\t"
+			"vst1.32   {d0-d3}, [%[dest],:128]!\n\t"
+			"bgt       1b\n\t"
+			: [dest] "+r" (dest), [bursts] "+r" (bursts)
+			: [value] "r" (value)
+			: "cc", "memory", "d0", "d1", "d2", "d3"
+			);
+		n &= 7;
+	}
+
+	while (n--)
+		*dest++ = value;
+}
+
+/* Copy a line front to back, safe when dest is below src */
+static void copy_line_forward(uint8_t *dest, uint8_t *src, int len)
+{
+	/* Single bytes up to the first burst boundary */
+	while (len > 0 && ((uintptr_t)dest & 15))
+	{
+		*dest++ = *src++;
+		len--;
+	}
+
+	if (len >= 32)
+	{
+		int bursts = len & ~31;
+
+		asm volatile (
+			"1:\n\t"
+			"pld       [%[src], #192]\n\t"
+			"vld1.8    {d0-d3}, [%[src]]!\n\t"
+			"subs      %[bursts],%[bursts],#32\n\t"
+			"vst1.8    {d0-d3}, [%[dest],:128]!\n\t"
+			"bgt       1b\n\t"
+			: [dest] "+r" (dest), [src] "+r" (src), [bursts] "+r" (bursts)
+			:
+			: "cc", "memory", "d0", "d1", "d2", "d3"
+			);
+		len &= 31;
+	}
+
+	while (len--)
+		*dest++ = *src++;
+}
+
+/* Copy a line back to front, safe when dest is above src */
+static void copy_line_backward(uint8_t *dest, uint8_t *src, int len)
+{
+	dest += len;
+	src += len;
+
+	/* Single bytes down to the last burst boundary */
+	while (len > 0 && ((uintptr_t)dest & 15))
+	{
+		*--dest = *--src;
+		len--;
+	}
+
+	if (len >= 32)
+	{
+		int bursts = len & ~31;
+
+		asm volatile (
+			"1:\n\t"
+			"sub       %[src],%[src],#32\n\t"
+			"sub       %[dest],%[dest],#32\n\t"
+			"pld       [%[src], #-192]\n\t"
+			"vld1.8    {d0-d3}, [%[src]]\n\t"
+			"subs      %[bursts],%[bursts],#32\n\t"
+			"vst1.8    {d0-d3}, [%[dest],:128]\n\t"
+			"bgt       1b\n\t"
+			: [dest] "+r" (dest), [src] "+r" (src), [bursts] "+r" (bursts)
+			:
+			: "cc", "memory", "d0", "d1", "d2", "d3"
+			);
+		len &= 31;
+	}
+
+	while (len--)
+		*--dest = *--src;
+}
+
+/* Copy a line out of uncached memory, which is only fast when read in
+ * whole aligned bursts
+ */
+static void readback_line(uint8_t *dest, uint8_t *src, int len)
+{
+	while (len > 0 && ((uintptr_t)src & 15))
+	{
+		*dest++ = *src++;
+		len--;
+	}
+
+	if (len >= 64)
+	{
+		int bursts = len & ~63;
+
+		asm volatile (
+			"1:\n\t"
+			"pld       [%[src], #256]\n\t"
+			"vld1.8    {d0-d3}, [%[src],:128]!\n\t"
+			"vld1.8    {d4-d7}, [%[src],:128]!\n\t"
+			"subs      %[bursts],%[bursts],#64\n\t"
+			"vst1.8    {d0-d3}, [%[dest]]!\n\t"
+			"vst1.8    {d4-d7}, [%[dest]]!\n\t"
+			"bgt       1b\n\t"
+			: [dest] "+r" (dest), [src] "+r" (src), [bursts] "+r" (bursts)
+			:
+			: "cc", "memory", "d0", "d1", "d2", "d3", "d4", "d5", "d6",
+			  "d7"
+			);
+		len &= 63;
+	}
+
+	while (len--)
+		*dest++ = *src++;
+}
+
+/* The composite spans below handle 8 (16 for a8) pixels per iteration
+ * with the source deinterleaved into planar B, G, R and A registers, and
+ * leave the remainder of the line to the C versions.
+ */
+
+/* Unpack 8 r5g6b5 pixels in q2 into planar 8 bit red in d6, green in d7
+ * and blue in d30 (clobbers q2)
+ */
+#define NEON_UNPACK_0565 \
+	"vshrn.u16   d6, q2, #8\n\t" \
+	"vshrn.u16   d7, q2, #3\n\t" \
+	"vsli.u16    q2, q2, #5\n\t" \
+	"vsri.u8     d6, d6, #5\n\t" \
+	"vsri.u8     d7, d7, #6\n\t" \
+	"vshrn.u16   d30, q2, #2\n\t"
+
+/* Pack planar 8 bit red in d16, green in d19 and blue in d18 into 8
+ * r5g6b5 pixels in q14 (clobbers q8, q9)
+ */
+#define NEON_PACK_0565 \
+	"vshll.u8    q14, d16, #8\n\t" \
+	"vshll.u8    q8, d19, #8\n\t" \
+	"vshll.u8    q9, d18, #8\n\t" \
+	"vsri.u16    q14, q8, #5\n\t" \
+	"vsri.u16    q14, q9, #11\n\t"
+
+/* OVER of 8 premultiplied source pixels in planar d0 (blue), d1 (green),
+ * d2 (red) and d3 (alpha) onto 8 r5g6b5 pixels in q2, with the result in
+ * q14 (clobbers d0-d7 and d16-d31)
+ */
+#define NEON_OVER_0565 \
+	NEON_UNPACK_0565 \
+	/* destination * (255 - alpha) / 255 */ \
+	"vmvn.8      d3, d3\n\t" \
+	"vmull.u8    q10, d3, d6\n\t" \
+	"vmull.u8    q11, d3, d7\n\t" \
+	"vmull.u8    q12, d3, d30\n\t" \
+	"vrshr.u16   q13, q10, #8\n\t" \
+	"vrshr.u16   q3, q11, #8\n\t" \
+	"vrshr.u16   q15, q12, #8\n\t" \
+	"vraddhn.u16 d20, q10, q13\n\t" \
+	"vraddhn.u16 d23, q11, q3\n\t" \
+	"vraddhn.u16 d22, q12, q15\n\t" \
+	/* + source */ \
+	"vqadd.u8    d16, d2, d20\n\t" \
+	"vqadd.u8    q9, q0, q11\n\t" \
+	NEON_PACK_0565
+
+static void over_span_8888_0565(uint16_t *dest, uint32_t *src, int w)
+{
+	if (w >= 8)
+	{
+		int n = w & ~7;
+
+		// avoid using d8-d15 (q4-q7) aapcs callee-save registers
+		asm volatile (
+			"1:\n\t"
+			"pld         [%[src], #128]\n\t"
+			"vld4.8      {d0-d3}, [%[src]]!\n\t"
+			"vld1.16     {d4-d5}, [%[dest]]\n\t"
+			NEON_OVER_0565
+			"subs        %[n], %[n], #8\n\t"
+			"vst1.16     {d28-d29}, [%[dest]]!\n\t"
+			"bgt         1b\n\t"
+			: [dest] "+r" (dest), [src] "+r" (src), [n] "+r" (n)
+			:
+			: "cc", "memory", "d0", "d1", "d2", "d3", "d4", "d5", "d6",
+			  "d7", "d16", "d17", "d18", "d19", "d20", "d21", "d22",
+			  "d23", "d24", "d25", "d26", "d27", "d28", "d29", "d30",
+			  "d31"
+			);
+		w &= 7;
+	}
+
+	over_line_8888_0565(dest, src, w);
+}
+
+static void over_n_8_span_0565(uint16_t *dest, uint8_t *mask, uint32_t src, int w)
+{
+	if (w >= 8)
+	{
+		int n = w & ~7;
+
+		/* The solid color lives in d8-d11 for the whole span, they are
+		 * callee-saved so they are preserved on the stack
+		 */
+		asm volatile (
+			"vpush       {d8-d11}\n\t"
+			"vdup.8      d8, %[b]\n\t"
+			"vdup.8      d9, %[g]\n\t"
+			"vdup.8      d10, %[r]\n\t"
+			"vdup.8      d11, %[a]\n\t"
+			"1:\n\t"
+			"vld1.8      {d31}, [%[mask]]!\n\t"
+			"vld1.16     {d4-d5}, [%[dest]]\n\t"
+			/* source IN mask */
+			"vmull.u8    q8, d31, d8\n\t"
+			"vmull.u8    q9, d31, d9\n\t"
+			"vmull.u8    q10, d31, d10\n\t"
+			"vmull.u8    q11, d31, d11\n\t"
+			"vrshr.u16   q12, q8, #8\n\t"
+			"vrshr.u16   q13, q9, #8\n\t"
+			"vraddhn.u16 d0, q8, q12\n\t"
+			"vraddhn.u16 d1, q9, q13\n\t"
+			"vrshr.u16   q12, q10, #8\n\t"
+			"vrshr.u16   q13, q11, #8\n\t"
+			"vraddhn.u16 d2, q10, q12\n\t"
+			"vraddhn.u16 d3, q11, q13\n\t"
+			NEON_OVER_0565
+			"subs        %[n], %[n], #8\n\t"
+			"vst1.16     {d28-d29}, [%[dest]]!\n\t"
+			"bgt         1b\n\t"
+			"vpop        {d8-d11}\n\t"
+			: [dest] "+r" (dest), [mask] "+r" (mask), [n] "+r" (n)
+			: [b] "r" (src), [g] "r" (src >> 8), [r] "r" (src >> 16),
+			  [a] "r" (src >> 24)
+			: "cc", "memory", "d0", "d1", "d2", "d3", "d4", "d5", "d6",
+			  "d7", "d16", "d17", "d18", "d19", "d20", "d21", "d22",
+			  "d23", "d24", "d25", "d26", "d27", "d28", "d29", "d30",
+			  "d31"
+			);
+		w &= 7;
+	}
+
+	over_n_8_line_0565(dest, mask, src, w);
+}
+
+static void add_span_8_8(uint8_t *dest, uint8_t *src, int w)
+{
+	if (w >= 16)
+	{
+		int n = w & ~15;
+
+		asm volatile (
+			"1:\n\t"
+			"vld1.8      {d0-d1}, [%[src]]!\n\t"
+			"vld1.8      {d2-d3}, [%[dest]]\n\t"
+			"vqadd.u8    q0, q0, q1\n\t"
+			"subs        %[n], %[n], #16\n\t"
+			"vst1.8      {d0-d1}, [%[dest]]!\n\t"
+			"bgt         1b\n\t"
+			: [dest] "+r" (dest), [src] "+r" (src), [n] "+r" (n)
+			:
+			: "cc", "memory", "d0", "d1", "d2", "d3"
+			);
+		w &= 15;
+	}
+
+	add_line_8_8(dest, src, w);
+}
+
+static void convert_span_8888_0565(uint16_t *dest, uint32_t *src, int w)
+{
+	if (w >= 8)
+	{
+		int n = w & ~7;
+
+		asm volatile (
+			"1:\n\t"
+			"pld         [%[src], #128]\n\t"
+			"vld4.8      {d0-d3}, [%[src]]!\n\t"
+			"vmov        d16, d2\n\t"
+			"vmov        d19, d1\n\t"
+			"vmov        d18, d0\n\t"
+			NEON_PACK_0565
+			"subs        %[n], %[n], #8\n\t"
+			"vst1.16     {d28-d29}, [%[dest]]!\n\t"
+			"bgt         1b\n\t"
+			: [dest] "+r" (dest), [src] "+r" (src), [n] "+r" (n)
+			:
+			: "cc", "memory", "d0", "d1", "d2", "d3", "d16", "d17",
+			  "d18", "d19", "d28", "d29"
+			);
+		w &= 7;
+	}
+
+	convert_line_8888_0565(dest, src, w);
+}
+
+static void convert_span_0565_8888(uint32_t *dest, uint16_t *src, int w)
+{
+	if (w >= 8)
+	{
+		int n = w & ~7;
+
+		asm volatile (
+			"vmov.i8     d3, #255\n\t"
+			"1:\n\t"
+			"vld1.16     {d4-d5}, [%[src]]!\n\t"
+			NEON_UNPACK_0565
+			"vmov        d2, d6\n\t"
+			"vmov        d1, d7\n\t"
+			"vmov        d0, d30\n\t"
+			"subs        %[n], %[n], #8\n\t"
+			"vst4.8      {d0-d3}, [%[dest]]!\n\t"
+			"bgt         1b\n\t"
+			: [dest] "+r" (dest), [src] "+r" (src), [n] "+r" (n)
+			:
+			: "cc", "memory", "d0", "d1", "d2", "d3", "d4", "d5", "d6",
+			  "d7", "d30"
+			);
+		w &= 7;
+	}
+
+	convert_line_0565_8888(dest, src, w);
+}
+
+#endif /* HAVE_NEON */
+
+/* Fill a rectangle of 16 bits per pixel with a solid color */
+void solid_fill_16(int w, int h, int pitch, uint16_t pixel, uint8_t *dest)
+{
+	int y;
+	uint32_t value = pixel | ((uint32_t)pixel << 16);
+
+	for (y = 0; y < h; y++)
+	{
+		uint16_t *d = (uint16_t *)(dest + y * pitch);
+		int x = w;
+
+		/* Single pixels up to the first burst boundary */
+		while (x > 0 && ((uintptr_t)d & 15))
+		{
+			*d++ = pixel;
+			x--;
+		}
+
+		fill_words((uint32_t *)d, x >> 1, value);
+
+		if (x & 1)
+			d[x - 1] = pixel;
+	}
+}
+
+/* Fill a rectangle of 32 bits per pixel with a solid color */
+void solid_fill_32(int w, int h, int pitch, uint32_t pixel, uint8_t *dest)
+{
+	int y;
+
+	for (y = 0; y < h; y++)
+	{
+		uint32_t *d = (uint32_t *)(dest + y * pitch);
+		int x = w;
+
+		while (x > 0 && ((uintptr_t)d & 15))
+		{
+			*d++ = pixel;
+			x--;
+		}
+
+		fill_words(d, x, pixel);
+	}
+}
+
+/* Copy a rectangle of w bytes by h lines between possibly overlapping
+ * areas, walking lines bottom up when ydir is negative and each line
+ * right to left when xdir is negative
+ */
+void blit_copy(int w, int h, int src_pitch, int dst_pitch, int xdir, int ydir, uint8_t *src, uint8_t *dest)
+{
+	int y;
+
+	if (ydir < 0)
+	{
+		src += (h - 1) * src_pitch;
+		dest += (h - 1) * dst_pitch;
+		src_pitch = -src_pitch;
+		dst_pitch = -dst_pitch;
+	}
+
+	for (y = 0; y < h; y++)
+	{
+		if (xdir < 0)
+			copy_line_backward(dest, src, w);
+		else
+			copy_line_forward(dest, src, w);
+
+		src += src_pitch;
+		dest += dst_pitch;
+	}
+}
+
+/* Copy a rectangle of w bytes by h lines out of the framebuffer, reading
+ * it in aligned bursts
+ */
+void readback_copy(int w, int h, int src_pitch, int dst_pitch, uint8_t *src, uint8_t *dest)
+{
+	int y;
+
+	for (y = 0; y < h; y++)
+		readback_line(dest + y * dst_pitch, src + y * src_pitch, w);
+}
+
+/* Render OVER of premultiplied a8r8g8b8 onto r5g6b5 */
+void over_8888_0565(int w, int h, int src_pitch, int dst_pitch, uint8_t *src, uint8_t *dest)
+{
+	int y;
+
+	for (y = 0; y < h; y++)
+		over_span_8888_0565((uint16_t *)(dest + y * dst_pitch),
+		                    (uint32_t *)(src + y * src_pitch), w);
+}
+
+/* Render OVER of a solid premultiplied a8r8g8b8 color through an a8 mask
+ * onto r5g6b5, used for drawing glyph strings
+ */
+void over_n_8_0565(int w, int h, int mask_pitch, int dst_pitch, uint32_t src, uint8_t *mask, uint8_t *dest)
+{
+	int y;
+
+	for (y = 0; y < h; y++)
+		over_n_8_span_0565((uint16_t *)(dest + y * dst_pitch),
+		                   mask + y * mask_pitch, src, w);
+}
+
+/* Render ADD of a8 onto a8, used for accumulating glyph masks */
+void add_8_8(int w, int h, int src_pitch, int dst_pitch, uint8_t *src, uint8_t *dest)
+{
+	int y;
+
+	for (y = 0; y < h; y++)
+		add_span_8_8(dest + y * dst_pitch, src + y * src_pitch, w);
+}
+
+/* Render SRC from a8r8g8b8/x8r8g8b8 to r5g6b5 */
+void convert_8888_0565(int w, int h, int src_pitch, int dst_pitch, uint8_t *src, uint8_t *dest)
+{
+	int y;
+
+	for (y = 0; y < h; y++)
+		convert_span_8888_0565((uint16_t *)(dest + y * dst_pitch),
+		                       (uint32_t *)(src + y * src_pitch), w);
+}
+
+/* Render SRC from r5g6b5 to a8r8g8b8/x8r8g8b8, alpha is set opaque */
+void convert_0565_8888(int w, int h, int src_pitch, int dst_pitch, uint8_t *src, uint8_t *dest)
+{
+	int y;
+
+	for (y = 0; y < h; y++)
+		convert_span_0565_8888((uint32_t *)(dest + y * dst_pitch),
+		                       (uint16_t *)(src + y * src_pitch), w);
+}
@@ -0,0 +1,63 @@
+/* Pixel kernels for the software EXA implementation
+ * Copyright 2008 Kalle Vahlman, <zuh@iki.fi>
+ *
+ * Permission to use, copy, modify, distribute and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the names of the authors and/or copyright holders
+ * not be used in advertising or publicity pertaining to distribution of the
+ * software without specific, written prior permission.  The authors and
+ * copyright holders make no representations about the suitability of this
+ * software for any purpose.  It is provided "as is" without any express
+ * or implied warranty.
+ *
+ * THE AUTHORS AND COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __EXA_KERNELS_H__
+#define __EXA_KERNELS_H__
+
+#include <stdint.h>
+
+/* Fill a rectangle of 16 bits per pixel with a solid color */
+void solid_fill_16(int w, int h, int pitch, uint16_t pixel, uint8_t *dest);
+
+/* Fill a rectangle of 32 bits per pixel with a solid color */
+void solid_fill_32(int w, int h, int pitch, uint32_t pixel, uint8_t *dest);
+
+/* Copy a rectangle of w bytes by h lines between possibly overlapping
+ * areas, walking lines bottom up when ydir is negative and each line
+ * right to left when xdir is negative
+ */
+void blit_copy(int w, int h, int src_pitch, int dst_pitch, int xdir, int ydir, uint8_t *src, uint8_t *dest);
+
+/* Copy a rectangle of w bytes by h lines out of the framebuffer, reading
+ * it in aligned bursts
+ */
+void readback_copy(int w, int h, int src_pitch, int dst_pitch, uint8_t *src, uint8_t *dest);
+
+/* Render OVER of premultiplied a8r8g8b8 onto r5g6b5 */
+void over_8888_0565(int w, int h, int src_pitch, int dst_pitch, uint8_t *src, uint8_t *dest);
+
+/* Render OVER of a solid premultiplied a8r8g8b8 color through an a8 mask
+ * onto r5g6b5, used for drawing glyph strings
+ */
+void over_n_8_0565(int w, int h, int mask_pitch, int dst_pitch, uint32_t src, uint8_t *mask, uint8_t *dest);
+
+/* Render ADD of a8 onto a8, used for accumulating glyph masks */
+void add_8_8(int w, int h, int src_pitch, int dst_pitch, uint8_t *src, uint8_t *dest);
+
+/* Render SRC from a8r8g8b8/x8r8g8b8 to r5g6b5 */
+void convert_8888_0565(int w, int h, int src_pitch, int dst_pitch, uint8_t *src, uint8_t *dest);
+
+/* Render SRC from r5g6b5 to a8r8g8b8/x8r8g8b8, alpha is set opaque */
+void convert_0565_8888(int w, int h, int src_pitch, int dst_pitch, uint8_t *src, uint8_t *dest);
+
+#endif /* __EXA_KERNELS_H__ */
@@ -35,25 +35,252 @@
 #include <stdint.h>
 #include <string.h>
 
-/* Basic line-based copy for packed formats */
-void packed_line_copy(int w, int h, int stride, uint8_t *src, uint8_t *dest)
+/* Copy h lines of len bytes between buffers of different pitch */
+static void plane_copy(int len, int h, int src_pitch, int dest_pitch, uint8_t *src, uint8_t *dest)
 {
 	int i;
-	int len = w * 2;
 	for (i = 0; i < h; i++)
 	{
-		memcpy(dest + i * len, src + i * stride, len);
+		memcpy(dest + i * dest_pitch, src + i * src_pitch, len);
+	}
+}
+
+/* Basic line-based copy for packed formats */
+void packed_line_copy(int w, int h, int stride, int dest_stride, uint8_t *src, uint8_t *dest)
+{
+	plane_copy(w * 2, h, stride, dest_stride, src, dest);
+}
+
+/* Line-based copy of YV12/I420 planes into separate Y, U and V planes,
+ * the destination chroma pitch is half the luma pitch
+ */
+void uv12_copy(int w, int h, int y_pitch, int uv_pitch, int dest_pitch, uint8_t *y_p, uint8_t *u_p, uint8_t *v_p, uint8_t *y_dest, uint8_t *u_dest, uint8_t *v_dest)
+{
+	plane_copy(w, h, y_pitch, dest_pitch, y_p, y_dest);
+	plane_copy(w / 2, h / 2, uv_pitch, dest_pitch / 2, u_p, u_dest);
+	plane_copy(w / 2, h / 2, uv_pitch, dest_pitch / 2, v_p, v_dest);
+}
+
+/* Line-based copy of NV12/NV21 into separate Y, U and V planes, the offsets
+ * give the position of U and V in the interleaved chroma pairs
+ */
+void nv_to_uv12(int w, int h, int y_pitch, int uv_pitch, int dest_pitch, int u_off, int v_off, uint8_t *y_p, uint8_t *uv_p, uint8_t *y_dest, uint8_t *u_dest, uint8_t *v_dest)
+{
+	int x, y;
+
+	plane_copy(w, h, y_pitch, dest_pitch, y_p, y_dest);
+
+	for (y=0; y<h/2; y++)
+	{
+		uint8_t *uv = uv_p + y * uv_pitch;
+		uint8_t *ud = u_dest + y * (dest_pitch / 2);
+		uint8_t *vd = v_dest + y * (dest_pitch / 2);
+
+		for (x=0; x<w/2; x++)
+		{
+			*ud++ = uv[u_off];
+			*vd++ = uv[v_off];
+			uv += 2;
+		}
+	}
+}
+
+/* Basic C implementation of packed YUV 4:2:2 (UYVY/YUY2) to planar 4:2:0
+ * conversion, the chroma of odd lines is dropped. The offsets give the
+ * position of the first Y, U and V byte in a macropixel.
+ */
+void packed_to_uv12(int w, int h, int stride, int dest_pitch, int y_off, int u_off, int v_off, uint8_t *src, uint8_t *y_dest, uint8_t *u_dest, uint8_t *v_dest)
+{
+	int x, y;
+
+	for (y=0; y<h; y++)
+	{
+		uint8_t *s = src + y * stride;
+		uint8_t *yd = y_dest + y * dest_pitch;
+		uint8_t *ud = u_dest + (y / 2) * (dest_pitch / 2);
+		uint8_t *vd = v_dest + (y / 2) * (dest_pitch / 2);
+
+		for (x=0; x<w; x+=2)
+		{
+			*yd++ = s[y_off];
+			*yd++ = s[y_off + 2];
+			if (!(y & 1))
+			{
+				*ud++ = s[u_off];
+				*vd++ = s[v_off];
+			}
+			s += 4;
+		}
+	}
+}
+
+/* Nearest neighbour scaling of a line of 8-bit samples, the samples are
+ * step bytes apart in the source. x and dx are 16.16 fixed point source
+ * positions.
+ */
+void scale_line_nearest(int w, int step, int x, int dx, uint8_t *src, uint8_t *dest)
+{
+	int i;
+
+	for (i=0; i<w; i++)
+	{
+		*dest++ = src[(x >> 16) * step];
+		x += dx;
+	}
+}
+
+/* Bilinear scaling of a line of 8-bit samples between two source lines,
+ * fy is the weight of the second line out of 256. len is the number of
+ * source samples, the last one is repeated past the edge.
+ */
+void scale_line_bilinear(int w, int step, int len, int x, int dx, int fy, uint8_t *src0, uint8_t *src1, uint8_t *dest)
+{
+	int i;
+
+	for (i=0; i<w; i++)
+	{
+		int sx = x >> 16;
+		int fx = (x >> 8) & 0xff;
+		int a0 = sx * step;
+		int a1 = (sx + 1 < len) ? a0 + step : a0;
+		int top = src0[a0] * (256 - fx) + src0[a1] * fx;
+		int bottom = src1[a0] * (256 - fx) + src1[a1] * fx;
+
+		*dest++ = (top * (256 - fy) + bottom * fy) >> 16;
+		x += dx;
+	}
+}
+
+/* BT.601 YUV to RGB in 10.6 fixed point, the same math the NEON version
+ * does with saturating 16-bit lanes
+ */
+#define YUV_CLAMP(v) ((v) < 0 ? 0 : ((v) > 255 ? 255 : (v)))
+#define YUV_TO_RGB(y, u, v, r, g, b) \
+	do { \
+		int c = ((y) - 16) * 75; \
+		int d = (u) - 128; \
+		int e = (v) - 128; \
+		r = (c + 102 * e) >> 6; \
+		g = (c - 25 * d - 52 * e) >> 6; \
+		b = (c + 129 * d) >> 6; \
+		r = YUV_CLAMP(r); \
+		g = YUV_CLAMP(g); \
+		b = YUV_CLAMP(b); \
+	} while (0)
+
+static void yuv444_to_rgb565_c(int w, uint8_t *y_p, uint8_t *u_p, uint8_t *v_p, uint16_t *dest)
+{
+	int i, r, g, b;
+
+	for (i=0; i<w; i++)
+	{
+		YUV_TO_RGB(y_p[i], u_p[i], v_p[i], r, g, b);
+		dest[i] = ((r & 0xf8) << 8) | ((g & 0xfc) << 3) | (b >> 3);
+	}
+}
+
+static void yuv444_to_xrgb8888_c(int w, uint8_t *y_p, uint8_t *u_p, uint8_t *v_p, uint32_t *dest)
+{
+	int i, r, g, b;
+
+	for (i=0; i<w; i++)
+	{
+		YUV_TO_RGB(y_p[i], u_p[i], v_p[i], r, g, b);
+		dest[i] = 0xff000000 | (r << 16) | (g << 8) | b;
+	}
+}
+
+/* Conversion of a line of YUV with horizontally halved chroma to RGB565,
+ * starting at pixel x. The steps are the bytes between luma samples and
+ * between chroma samples, so this takes planar, semi-planar and packed
+ * lines alike.
+ */
+void yuv_line_to_rgb565(int w, int x, int y_step, int uv_step, uint8_t *y_p, uint8_t *u_p, uint8_t *v_p, uint16_t *dest)
+{
+	int i, r, g, b;
+
+	for (i=0; i<w; i++, x++)
+	{
+		YUV_TO_RGB(y_p[x * y_step], u_p[(x >> 1) * uv_step],
+		           v_p[(x >> 1) * uv_step], r, g, b);
+		dest[i] = ((r & 0xf8) << 8) | ((g & 0xfc) << 3) | (b >> 3);
 	}
 }
 
 #ifndef HAVE_NEON
 
+/* Line-based copy between the UYVY and YUY2 byte orders, swapping the
+ * bytes of each pair on the way
+ */
+void packed_swap_copy(int w, int h, int stride, int dest_stride, uint8_t *src, uint8_t *dest)
+{
+	int x, y;
+
+	for (y=0; y<h; y++)
+	{
+		uint8_t *s = src + y * stride;
+		uint8_t *d = dest + y * dest_stride;
+
+		for (x=0; x<w; x++)
+		{
+			d[0] = s[1];
+			d[1] = s[0];
+			s += 2;
+			d += 2;
+		}
+	}
+}
+
+/* Basic C implementation of semi-planar NV12/NV21 to UYVY conversion, the
+ * offsets give the position of U and V in the interleaved chroma pairs
+ */
+static void nv_to_uyvy(int w, int h, int y_pitch, int uv_pitch, int dest_pitch, int u_off, int v_off, uint8_t *y_p, uint8_t *uv_p, uint8_t *dest)
+{
+	int x, y;
+
+	for (y=0; y<h; y+=2)
+	{
+		uint8_t *y_even = y_p + y * y_pitch;
+		uint8_t *y_odd = y_even + y_pitch;
+		uint8_t *uv = uv_p + (y / 2) * uv_pitch;
+		uint8_t *dest_even = dest + y * dest_pitch;
+		uint8_t *dest_odd = dest_even + dest_pitch;
+
+		for (x=0; x<w; x+=2)
+		{
+			uint8_t u_val = uv[u_off];
+			uint8_t v_val = uv[v_off];
+			uv += 2;
+
+			*dest_even++ = u_val;
+			*dest_even++ = *y_even++;
+			*dest_even++ = v_val;
+			*dest_even++ = *y_even++;
+
+			*dest_odd++ = u_val;
+			*dest_odd++ = *y_odd++;
+			*dest_odd++ = v_val;
+			*dest_odd++ = *y_odd++;
+		}
+	}
+}
+
+void nv12_to_uyvy(int w, int h, int y_pitch, int uv_pitch, int dest_pitch, uint8_t *y_p, uint8_t *uv_p, uint8_t *dest)
+{
+	nv_to_uyvy(w, h, y_pitch, uv_pitch, dest_pitch, 0, 1, y_p, uv_p, dest);
+}
+
+void nv21_to_uyvy(int w, int h, int y_pitch, int uv_pitch, int dest_pitch, uint8_t *y_p, uint8_t *uv_p, uint8_t *dest)
+{
+	nv_to_uyvy(w, h, y_pitch, uv_pitch, dest_pitch, 1, 0, y_p, uv_p, dest);
+}
+
 /* Basic C implementation of YV12/I420 to UYVY conversion */
-void uv12_to_uyvy(int w, int h, int y_pitch, int uv_pitch, uint8_t *y_p, uint8_t *u_p, uint8_t *v_p, uint8_t *dest)
+void uv12_to_uyvy(int w, int h, int y_pitch, int uv_pitch, int dest_pitch, uint8_t *y_p, uint8_t *u_p, uint8_t *v_p, uint8_t *dest)
 {
 	int x, y;
 	uint8_t *dest_even = dest;
-	uint8_t *dest_odd = dest + w * 2;
+	uint8_t *dest_odd = dest + dest_pitch;
 	uint8_t *y_p_even = y_p;
 	uint8_t *y_p_odd = y_p + y_pitch;
 
@@ -82,8 +309,8 @@ void uv12_to_uyvy(int w, int h, int y_pitch, int uv_pitch, uint8_t *y_p, uint8_t
 			*dest_odd++ = *y_p_odd++;
 		}
 
-		dest_even += w * 2;
-		dest_odd += w * 2;
+		dest_even += dest_pitch * 2 - w * 2;
+		dest_odd += dest_pitch * 2 - w * 2;
 
 		u_p += ((uv_pitch << 1) - w) >> 1;
 		v_p += ((uv_pitch << 1) - w) >> 1;
@@ -93,15 +320,63 @@ void uv12_to_uyvy(int w, int h, int y_pitch, int uv_pitch, uint8_t *y_p, uint8_t
 	}
 }
 
+/* Conversion of a line of full resolution YUV samples to RGB */
+void yuv444_to_rgb565(int w, uint8_t *y_p, uint8_t *u_p, uint8_t *v_p, uint16_t *dest)
+{
+	yuv444_to_rgb565_c(w, y_p, u_p, v_p, dest);
+}
+
+void yuv444_to_xrgb8888(int w, uint8_t *y_p, uint8_t *u_p, uint8_t *v_p, uint32_t *dest)
+{
+	yuv444_to_xrgb8888_c(w, y_p, u_p, v_p, dest);
+}
+
 #endif /* ! HAVE_NEON */
 
 #ifdef HAVE_NEON
 
-void uv12_to_uyvy(int w, int h, int y_pitch, int uv_pitch, uint8_t *y_p, uint8_t *u_p, uint8_t *v_p, uint8_t *dest)
+void packed_swap_copy(int w, int h, int stride, int dest_stride, uint8_t *src, uint8_t *dest)
+{
+    int x, y;
+
+    for (y=0; y<h; y++)
+    {
+        uint8_t *s = src + y * stride;
+        uint8_t *d = dest + y * dest_stride;
+
+        x = w;
+        if (x >= 16)
+        {
+            // 16 pixels (32 bytes) at a time, vrev16 swaps each byte pair
+            asm volatile (
+                    "1:\n\t"
+                    "vld1.u8   {q0,q1}, [%[s]]!\n\t"
+                    "sub       %[x],%[x],#16\n\t"
+                    "cmp       %[x],#16\n\t"
+                    "vrev16.8  q0, q0\n\t"
+                    "vrev16.8  q1, q1\n\t"
+                    "vst1.u8   {q0,q1}, [%[d]]!\n\t"
+                    "bhs       1b\n\t"
+                    : [s] "+r" (s), [d] "+r" (d), [x] "+r" (x)
+                    :
+                    : "cc", "memory", "d0","d1","d2","d3"
+                    );
+        }
+        while (x-- > 0)
+        {
+            d[0] = s[1];
+            d[1] = s[0];
+            s += 2;
+            d += 2;
+        }
+    }
+}
+
+void uv12_to_uyvy(int w, int h, int y_pitch, int uv_pitch, int dest_pitch, uint8_t *y_p, uint8_t *u_p, uint8_t *v_p, uint8_t *dest)
 {
     int x, y;
     uint8_t *dest_even = dest;
-    uint8_t *dest_odd = dest + w * 2;
+    uint8_t *dest_odd = dest + dest_pitch;
     uint8_t *y_p_even = y_p;
     uint8_t *y_p_odd = y_p + y_pitch;
 
@@ -132,8 +407,8 @@ void uv12_to_uyvy(int w, int h, int y_pitch, int uv_pitch, uint8_t *y_p, uint8_t
                 *dest_odd++ = *y_p_odd++;
             }
 
-            dest_even += w * 2;
-            dest_odd += w * 2;
+            dest_even += dest_pitch * 2 - w * 2;
+            dest_odd += dest_pitch * 2 - w * 2;
 
             u_p += ((uv_pitch << 1) - w) >> 1;
             v_p += ((uv_pitch << 1) - w) >> 1;
@@ -185,8 +460,8 @@ void uv12_to_uyvy(int w, int h, int y_pitch, int uv_pitch, uint8_t *y_p, uint8_t
             }
             while (x!=0);
 
-            dest_even += w * 2;
-            dest_odd += w * 2;
+            dest_even += dest_pitch * 2 - w * 2;
+            dest_odd += dest_pitch * 2 - w * 2;
 
             u_p += ((uv_pitch << 1) - w) >> 1;
             v_p += ((uv_pitch << 1) - w) >> 1;
@@ -197,4 +472,199 @@ void uv12_to_uyvy(int w, int h, int y_pitch, int uv_pitch, uint8_t *y_p, uint8_t
     }
 }
 
+/* The interleaved chroma pairs of a semi-planar image are stored with the
+ * luma as a 2-element structure, which gives UYVY directly. NV21 has the
+ * chroma the other way around, so each pair is swapped first.
+ */
+static void nv_to_uyvy(int w, int h, int y_pitch, int uv_pitch, int dest_pitch, int swap, uint8_t *y_p, uint8_t *uv_p, uint8_t *dest)
+{
+    int x, y;
+
+    for (y=0; y<h; y+=2)
+    {
+        uint8_t *y_even = y_p + y * y_pitch;
+        uint8_t *y_odd = y_even + y_pitch;
+        uint8_t *uv = uv_p + (y / 2) * uv_pitch;
+        uint8_t *dest_even = dest + y * dest_pitch;
+        uint8_t *dest_odd = dest_even + dest_pitch;
+
+        if (w<16)
+        {
+            for (x=0; x<w; x+=2)
+            {
+                uint8_t u_val = uv[swap];
+                uint8_t v_val = uv[!swap];
+                uv += 2;
+
+                *dest_even++ = u_val;
+                *dest_even++ = *y_even++;
+                *dest_even++ = v_val;
+                *dest_even++ = *y_even++;
+
+                *dest_odd++ = u_val;
+                *dest_odd++ = *y_odd++;
+                *dest_odd++ = v_val;
+                *dest_odd++ = *y_odd++;
+            }
+            continue;
+        }
+
+        x=w;
+        do {
+            // avoid using d8-d15 (q4-q7) aapcs callee-save registers
+            if (swap)
+                asm volatile (
+                        "1:\n\t"
+                        "vld1.u8   {q0}, [%[uv]]!\n\t"
+                        "sub       %[x],%[x],#16\n\t"
+                        "cmp       %[x],#16\n\t"
+                        "vld1.u8   {q1}, [%[y_even]]!\n\t"
+                        "vrev16.8  q0, q0\n\t"
+                        "vld1.u8   {q2}, [%[y_odd]]!\n\t"
+                        "vst2.u8   {q0,q1}, [%[dest_even]]!\n\t"
+                        "vmov.u8   q1, q2\n\t"
+                        "vst2.u8   {q0,q1}, [%[dest_odd]]!\n\t"
+                        "bhs       1b\n\t"
+                        : [uv] "+r" (uv), [y_even] "+r" (y_even), [y_odd] "+r" (y_odd),
+                          [dest_even] "+r" (dest_even), [dest_odd] "+r" (dest_odd),
+                          [x] "+r" (x)
+                        :
+                        : "cc", "memory", "d0","d1","d2","d3","d4","d5"
+                        );
+            else
+                asm volatile (
+                        "1:\n\t"
+                        "vld1.u8   {q0}, [%[uv]]!\n\t"
+                        "sub       %[x],%[x],#16\n\t"
+                        "cmp       %[x],#16\n\t"
+                        "vld1.u8   {q1}, [%[y_even]]!\n\t"
+                        "vld1.u8   {q2}, [%[y_odd]]!\n\t"
+                        "vst2.u8   {q0,q1}, [%[dest_even]]!\n\t"
+                        "vmov.u8   q1, q2\n\t"
+                        "vst2.u8   {q0,q1}, [%[dest_odd]]!\n\t"
+                        "bhs       1b\n\t"
+                        : [uv] "+r" (uv), [y_even] "+r" (y_even), [y_odd] "+r" (y_odd),
+                          [dest_even] "+r" (dest_even), [dest_odd] "+r" (dest_odd),
+                          [x] "+r" (x)
+                        :
+                        : "cc", "memory", "d0","d1","d2","d3","d4","d5"
+                        );
+            if (x!=0)
+            {
+                // overlap final 16-pixel block to process requested width exactly
+                x = 16-x;
+                uv -= x;
+                y_even -= x;
+                y_odd -= x;
+                dest_even -= x*2;
+                dest_odd -= x*2;
+                x = 16;
+                // do another 16-pixel block
+            }
+        }
+        while (x!=0);
+    }
+}
+
+void nv12_to_uyvy(int w, int h, int y_pitch, int uv_pitch, int dest_pitch, uint8_t *y_p, uint8_t *uv_p, uint8_t *dest)
+{
+    nv_to_uyvy(w, h, y_pitch, uv_pitch, dest_pitch, 0, y_p, uv_p, dest);
+}
+
+void nv21_to_uyvy(int w, int h, int y_pitch, int uv_pitch, int dest_pitch, uint8_t *y_p, uint8_t *uv_p, uint8_t *dest)
+{
+    nv_to_uyvy(w, h, y_pitch, uv_pitch, dest_pitch, 1, y_p, uv_p, dest);
+}
+
+/* Common part of the YUV to RGB conversion of 8 pixels: Y, U and V are
+ * loaded into d0-d2, the results are left in d3 (R), d4 (G) and d5 (B).
+ * d6/d7 hold the coefficients and d30/d31 the offsets 16 and 128.
+ */
+#define NEON_YUV_TO_RGB \
+    "vld1.u8   {d0}, [%[y_p]]!\n\t" \
+    "vld1.u8   {d1}, [%[u_p]]!\n\t" \
+    "vld1.u8   {d2}, [%[v_p]]!\n\t" \
+    "vsubl.u8  q8, d0, d30\n\t" \
+    "vsubl.u8  q9, d1, d31\n\t" \
+    "vsubl.u8  q10, d2, d31\n\t" \
+    "vmul.s16  q8, q8, d7[0]\n\t" \
+    "vmul.s16  q11, q10, d7[1]\n\t" \
+    "vmul.s16  q12, q9, d6[0]\n\t" \
+    "vmul.s16  q13, q9, d7[2]\n\t" \
+    "vmla.s16  q13, q10, d7[3]\n\t" \
+    "vqadd.s16 q11, q11, q8\n\t" \
+    "vqadd.s16 q12, q12, q8\n\t" \
+    "vqsub.s16 q13, q8, q13\n\t" \
+    "vqshrun.s16 d3, q11, #6\n\t" \
+    "vqshrun.s16 d4, q13, #6\n\t" \
+    "vqshrun.s16 d5, q12, #6\n\t"
+
+static const int16_t yuv_coefficients[8] = { 129, 0, 0, 0, 75, 102, 25, 52 };
+
+void yuv444_to_rgb565(int w, uint8_t *y_p, uint8_t *u_p, uint8_t *v_p, uint16_t *dest)
+{
+    int x = w & ~7;
+
+    if (x)
+    {
+        // avoid using d8-d15 (q4-q7) aapcs callee-save registers
+        asm volatile (
+                "vld1.16   {d6,d7}, [%[coef]]\n\t"
+                "vmov.i8   d30, #16\n\t"
+                "vmov.i8   d31, #128\n\t"
+                "1:\n\t"
+                NEON_YUV_TO_RGB
+                "subs      %[x],%[x],#8\n\t"
+                // pack R, G and B into the top bits of 16-bit lanes
+                "vshll.u8  q8, d3, #8\n\t"
+                "vshll.u8  q9, d4, #8\n\t"
+                "vshll.u8  q10, d5, #8\n\t"
+                "vsri.u16  q8, q9, #5\n\t"
+                "vsri.u16  q8, q10, #11\n\t"
+                "vst1.16   {q8}, [%[dest]]!\n\t"
+                "bgt       1b\n\t"
+                : [y_p] "+r" (y_p), [u_p] "+r" (u_p), [v_p] "+r" (v_p),
+                  [dest] "+r" (dest), [x] "+r" (x)
+                : [coef] "r" (yuv_coefficients)
+                : "cc", "memory", "d0","d1","d2","d3","d4","d5","d6","d7",
+                  "d16","d17","d18","d19","d20","d21","d22","d23",
+                  "d24","d25","d26","d27","d30","d31"
+                );
+    }
+    yuv444_to_rgb565_c(w & 7, y_p, u_p, v_p, dest);
+}
+
+void yuv444_to_xrgb8888(int w, uint8_t *y_p, uint8_t *u_p, uint8_t *v_p, uint32_t *dest)
+{
+    int x = w & ~7;
+
+    if (x)
+    {
+        // avoid using d8-d15 (q4-q7) aapcs callee-save registers
+        asm volatile (
+                "vld1.16   {d6,d7}, [%[coef]]\n\t"
+                "vmov.i8   d30, #16\n\t"
+                "vmov.i8   d31, #128\n\t"
+                "1:\n\t"
+                NEON_YUV_TO_RGB
+                "subs      %[x],%[x],#8\n\t"
+                // store as B, G, R, X bytes
+                "vmov      d2, d5\n\t"
+                "vmov      d5, d3\n\t"
+                "vmov      d3, d4\n\t"
+                "vmov      d4, d5\n\t"
+                "vmov.i8   d5, #255\n\t"
+                "vst4.8    {d2,d3,d4,d5}, [%[dest]]!\n\t"
+                "bgt       1b\n\t"
+                : [y_p] "+r" (y_p), [u_p] "+r" (u_p), [v_p] "+r" (v_p),
+                  [dest] "+r" (dest), [x] "+r" (x)
+                : [coef] "r" (yuv_coefficients)
+                : "cc", "memory", "d0","d1","d2","d3","d4","d5","d6","d7",
+                  "d16","d17","d18","d19","d20","d21","d22","d23",
+                  "d24","d25","d26","d27","d30","d31"
+                );
+    }
+    yuv444_to_xrgb8888_c(w & 7, y_p, u_p, v_p, dest);
+}
+
 #endif /* HAVE_NEON */
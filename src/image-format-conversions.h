@@ -27,10 +27,37 @@
 #include <stdint.h>
 
 /* Basic line-based copy for packed formats */
-void packed_line_copy(int w, int h, int stride, uint8_t *src, uint8_t *dest);
+void packed_line_copy(int w, int h, int stride, int dest_stride, uint8_t *src, uint8_t *dest);
+
+/* Line-based copy between the UYVY and YUY2 byte orders */
+void packed_swap_copy(int w, int h, int stride, int dest_stride, uint8_t *src, uint8_t *dest);
 
 /* Basic C implementation of YV12/I420 to UYVY conversion */
-void uv12_to_uyvy(int w, int h, int y_pitch, int uv_pitch, uint8_t *y_p, uint8_t *u_p, uint8_t *v_p, uint8_t *dest);
+void uv12_to_uyvy(int w, int h, int y_pitch, int uv_pitch, int dest_pitch, uint8_t *y_p, uint8_t *u_p, uint8_t *v_p, uint8_t *dest);
+
+/* Conversion of semi-planar NV12/NV21 to UYVY */
+void nv12_to_uyvy(int w, int h, int y_pitch, int uv_pitch, int dest_pitch, uint8_t *y_p, uint8_t *uv_p, uint8_t *dest);
+void nv21_to_uyvy(int w, int h, int y_pitch, int uv_pitch, int dest_pitch, uint8_t *y_p, uint8_t *uv_p, uint8_t *dest);
+
+/* Line-based copy of NV12/NV21 into separate Y, U and V planes */
+void nv_to_uv12(int w, int h, int y_pitch, int uv_pitch, int dest_pitch, int u_off, int v_off, uint8_t *y_p, uint8_t *uv_p, uint8_t *y_dest, uint8_t *u_dest, uint8_t *v_dest);
+
+/* Line-based copy of YV12/I420 planes into separate Y, U and V planes */
+void uv12_copy(int w, int h, int y_pitch, int uv_pitch, int dest_pitch, uint8_t *y_p, uint8_t *u_p, uint8_t *v_p, uint8_t *y_dest, uint8_t *u_dest, uint8_t *v_dest);
+
+/* Basic C implementation of packed YUV 4:2:2 to planar 4:2:0 conversion */
+void packed_to_uv12(int w, int h, int stride, int dest_pitch, int y_off, int u_off, int v_off, uint8_t *src, uint8_t *y_dest, uint8_t *u_dest, uint8_t *v_dest);
+
+/* Scaling of a line of 8-bit samples */
+void scale_line_nearest(int w, int step, int x, int dx, uint8_t *src, uint8_t *dest);
+void scale_line_bilinear(int w, int step, int len, int x, int dx, int fy, uint8_t *src0, uint8_t *src1, uint8_t *dest);
+
+/* Conversion of a line of full resolution YUV samples to RGB */
+void yuv444_to_rgb565(int w, uint8_t *y_p, uint8_t *u_p, uint8_t *v_p, uint16_t *dest);
+void yuv444_to_xrgb8888(int w, uint8_t *y_p, uint8_t *u_p, uint8_t *v_p, uint32_t *dest);
+
+/* Conversion of a line of YUV with halved chroma to RGB565, unscaled */
+void yuv_line_to_rgb565(int w, int x, int y_step, int uv_step, uint8_t *y_p, uint8_t *u_p, uint8_t *v_p, uint16_t *dest);
 
 #endif /* __IMAGE_FORMAT_CONVERSIONS_H__ */
 
@@ -0,0 +1,511 @@
+/* Texas Instruments OMAP framebuffer driver for X.Org
+ * Copyright 2008 Kalle Vahlman, <zuh@iki.fi>
+ *
+ * Permission to use, copy, modify, distribute and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the names of the authors and/or copyright holders
+ * not be used in advertising or publicity pertaining to distribution of the
+ * software without specific, written prior permission.  The authors and
+ * copyright holders make no representations about the suitability of this
+ * software for any purpose.  It is provided "as is" without any express
+ * or implied warranty.
+ *
+ * THE AUTHORS AND COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Hardware cursor on the VID2 plane
+ *
+ * The cursor image is kept as RGB565 in a small plane of its own, with
+ * transparent pixels set to a video source color key. Moving the cursor
+ * is then only a matter of moving the plane, nothing is drawn into or
+ * restored from the gfx plane.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "omapfb-driver.h"
+#include "omapfb.h"
+
+#include "xf86.h"
+#include "xf86_OSlib.h"
+#include "xf86Cursor.h"
+#include "cursorstr.h"
+#include "servermd.h"
+
+/* FIXME: Not like this, take it from the xorg.conf or autodetect or whatever */
+#define OMAP_FBDEV2_NAME "/dev/fb2"
+
+/* Transparent pixels in the cursor image, cursor pixels that happen to
+ * have this color are nudged to a neighbouring one
+ */
+#define OMAPFB_CURSOR_KEY 0xf81f
+
+#define RGB_TO_565(c) \
+	((((c) >> 8) & 0xf800) | (((c) >> 5) & 0x07e0) | (((c) >> 3) & 0x001f))
+
+static CARD16
+OMAPFBCursorPixel(CARD32 rgb)
+{
+	CARD16 p = RGB_TO_565(rgb);
+
+	return p == OMAPFB_CURSOR_KEY ? p ^ 0x0020 : p;
+}
+
+/* Draw the cursor image into the plane at the current offset, the rest of
+ * the plane is left transparent
+ */
+static void
+OMAPFBCursorDraw(OMAPFBCursorPtr cursor)
+{
+	CARD16 *dest = (CARD16 *)cursor->fb;
+	int x, y;
+
+	for (y = 0; y < OMAPFB_CURSOR_SIZE; y++) {
+		int sy = y - cursor->offset_y;
+
+		for (x = 0; x < OMAPFB_CURSOR_SIZE; x++) {
+			int sx = x - cursor->offset_x;
+
+			if (sx < 0 || sy < 0
+			 || sx >= OMAPFB_CURSOR_SIZE || sy >= OMAPFB_CURSOR_SIZE)
+				*dest++ = OMAPFB_CURSOR_KEY;
+			else
+				*dest++ = cursor->image[sy * OMAPFB_CURSOR_SIZE + sx];
+		}
+	}
+}
+
+/* Turn the 2-color cursor bits into RGB565 with the current colors */
+static void
+OMAPFBCursorColorize(OMAPFBCursorPtr cursor)
+{
+	int i;
+
+	for (i = 0; i < OMAPFB_CURSOR_SIZE * OMAPFB_CURSOR_SIZE; i++) {
+		switch (cursor->bits[i]) {
+			case OMAPFB_CURSOR_BG:
+				cursor->image[i] = cursor->bg;
+				break;
+			case OMAPFB_CURSOR_FG:
+				cursor->image[i] = cursor->fg;
+				break;
+			default:
+				cursor->image[i] = OMAPFB_CURSOR_KEY;
+				break;
+		}
+	}
+}
+
+static void
+OMAPFBSetCursorColors(ScrnInfoPtr pScrn, int bg, int fg)
+{
+	OMAPFBCursorPtr cursor = OMAPFB(pScrn)->cursor;
+
+	cursor->bg = OMAPFBCursorPixel(bg);
+	cursor->fg = OMAPFBCursorPixel(fg);
+
+	if (!cursor->argb) {
+		OMAPFBCursorColorize(cursor);
+		OMAPFBCursorDraw(cursor);
+	}
+}
+
+static void
+OMAPFBSetCursorPosition(ScrnInfoPtr pScrn, int x, int y)
+{
+	OMAPFBPtr ofb = OMAPFB(pScrn);
+	OMAPFBCursorPtr cursor = ofb->cursor;
+	int max_x = ofb->state_info.xres - OMAPFB_CURSOR_SIZE;
+	int max_y = ofb->state_info.yres - OMAPFB_CURSOR_SIZE;
+	int pos_x, pos_y;
+
+	/* The plane has to stay on screen, so near the edges it stops and
+	 * the image is moved inside it instead
+	 */
+	pos_x = x < 0 ? 0 : (x > max_x ? max_x : x);
+	pos_y = y < 0 ? 0 : (y > max_y ? max_y : y);
+
+	if (x - pos_x != cursor->offset_x || y - pos_y != cursor->offset_y) {
+		cursor->offset_x = x - pos_x;
+		cursor->offset_y = y - pos_y;
+		OMAPFBCursorDraw(cursor);
+	}
+
+	if (pos_x == cursor->plane_info.pos_x
+	 && pos_y == cursor->plane_info.pos_y)
+		return;
+
+	cursor->plane_info.pos_x = pos_x;
+	cursor->plane_info.pos_y = pos_y;
+	if (ioctl(cursor->fd, OMAPFB_SETUP_PLANE, &cursor->plane_info)) {
+		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+		           "Moving cursor plane failed: %s\n", strerror(errno));
+	}
+}
+
+static void
+OMAPFBLoadCursorImage(ScrnInfoPtr pScrn, unsigned char *bits)
+{
+	OMAPFBCursorPtr cursor = OMAPFB(pScrn)->cursor;
+
+	memcpy(cursor->bits, bits, sizeof(cursor->bits));
+	cursor->argb = FALSE;
+
+	OMAPFBCursorColorize(cursor);
+	OMAPFBCursorDraw(cursor);
+}
+
+static void
+OMAPFBCursorSetEnabled(ScrnInfoPtr pScrn, Bool enabled)
+{
+	OMAPFBCursorPtr cursor = OMAPFB(pScrn)->cursor;
+
+	/* Without the color key the plane would cover the screen with
+	 * its transparent pixels
+	 */
+	cursor->shown = enabled;
+	if (cursor->yielded)
+		enabled = FALSE;
+
+	if (cursor->plane_info.enabled == enabled)
+		return;
+
+	cursor->plane_info.enabled = enabled;
+	if (ioctl(cursor->fd, OMAPFB_SETUP_PLANE, &cursor->plane_info)) {
+		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+		           "%s cursor plane failed: %s\n",
+		           enabled ? "Enabling" : "Disabling", strerror(errno));
+	}
+}
+
+static void
+OMAPFBHideCursor(ScrnInfoPtr pScrn)
+{
+	OMAPFBCursorSetEnabled(pScrn, FALSE);
+}
+
+static void
+OMAPFBShowCursor(ScrnInfoPtr pScrn)
+{
+	OMAPFBCursorSetEnabled(pScrn, TRUE);
+}
+
+/* Realize a 2-color cursor as one byte per pixel of the full cursor size */
+static unsigned char *
+OMAPFBRealizeCursor(xf86CursorInfoPtr info, CursorPtr pCurs)
+{
+	CursorBitsPtr bits = pCurs->bits;
+	int stride = BitmapBytePad(bits->width);
+	unsigned char *image;
+	int x, y;
+
+	image = xcalloc(OMAPFB_CURSOR_SIZE * OMAPFB_CURSOR_SIZE, 1);
+	if (!image)
+		return NULL;
+
+	for (y = 0; y < bits->height && y < OMAPFB_CURSOR_SIZE; y++) {
+		for (x = 0; x < bits->width && x < OMAPFB_CURSOR_SIZE; x++) {
+			int i = y * stride + x / 8;
+#if BITMAP_BIT_ORDER == MSBFirst
+			int bit = 0x80 >> (x & 7);
+#else
+			int bit = 1 << (x & 7);
+#endif
+			if (!(bits->mask[i] & bit))
+				continue;
+
+			image[y * OMAPFB_CURSOR_SIZE + x] =
+				(bits->source[i] & bit) ? OMAPFB_CURSOR_FG
+				                        : OMAPFB_CURSOR_BG;
+		}
+	}
+
+	return image;
+}
+
+/* While XV has the color key, new cursors are drawn by the sprite */
+static Bool
+OMAPFBUseHWCursor(ScreenPtr pScreen, CursorPtr pCurs)
+{
+	OMAPFBCursorPtr cursor = OMAPFB(xf86Screens[pScreen->myNum])->cursor;
+
+	return !cursor->yielded
+	    && pCurs->bits->width <= OMAPFB_CURSOR_SIZE
+	    && pCurs->bits->height <= OMAPFB_CURSOR_SIZE;
+}
+
+#ifdef ARGB_CURSOR
+/* The plane has no alpha, so translucent pixels are either drawn opaque
+ * or left out
+ */
+static void
+OMAPFBLoadCursorARGB(ScrnInfoPtr pScrn, CursorPtr pCurs)
+{
+	OMAPFBCursorPtr cursor = OMAPFB(pScrn)->cursor;
+	CursorBitsPtr bits = pCurs->bits;
+	int x, y;
+
+	for (y = 0; y < OMAPFB_CURSOR_SIZE; y++) {
+		for (x = 0; x < OMAPFB_CURSOR_SIZE; x++) {
+			CARD32 p, a;
+
+			cursor->image[y * OMAPFB_CURSOR_SIZE + x] = OMAPFB_CURSOR_KEY;
+			if (x >= bits->width || y >= bits->height)
+				continue;
+
+			p = bits->argb[y * bits->width + x];
+			a = p >> 24;
+			if (a < 0x80)
+				continue;
+
+			/* Undo the premultiplication */
+			p = (((((p >> 16) & 0xff) * 0xff / a) << 16)
+			   | ((((p >> 8) & 0xff) * 0xff / a) << 8)
+			   | ((p & 0xff) * 0xff / a));
+			cursor->image[y * OMAPFB_CURSOR_SIZE + x] =
+				OMAPFBCursorPixel(p);
+		}
+	}
+	cursor->argb = TRUE;
+
+	OMAPFBCursorDraw(cursor);
+}
+#endif
+
+/* Let the gfx plane show through the transparent pixels */
+static Bool
+OMAPFBCursorSetKey(ScrnInfoPtr pScrn, OMAPFBCursorPtr cursor)
+{
+	struct omapfb_color_key key;
+
+	memset(&key, 0, sizeof(key));
+	key.channel_out = OMAPFB_CHANNEL_OUT_LCD;
+	key.key_type = OMAPFB_COLOR_KEY_VID_SRC;
+	key.trans_key = OMAPFB_CURSOR_KEY;
+	if (ioctl(cursor->fd, OMAPFB_SET_COLOR_KEY, &key)) {
+		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+		           "Failed to set cursor color key: %s\n", strerror(errno));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Set up the cursor plane, it will stay disabled until the cursor is shown */
+static Bool
+OMAPFBCursorSetupPlane(ScrnInfoPtr pScrn, OMAPFBCursorPtr cursor)
+{
+	if (ioctl(cursor->fd, OMAPFB_QUERY_PLANE, &cursor->plane_info)) {
+		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+		           "Failed to fetch cursor plane info\n");
+		return FALSE;
+	}
+	cursor->plane_info.enabled = 0;
+	if (ioctl(cursor->fd, OMAPFB_SETUP_PLANE, &cursor->plane_info)) {
+		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+		           "Failed to setup cursor plane\n");
+		return FALSE;
+	}
+
+	cursor->mem_info.size = OMAPFB_CURSOR_SIZE * OMAPFB_CURSOR_SIZE * 2;
+	cursor->mem_info.type = OMAPFB_MEMTYPE_SDRAM;
+	if (ioctl(cursor->fd, OMAPFB_SETUP_MEM, &cursor->mem_info)) {
+		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+		           "Failed to allocate cursor plane memory\n");
+		return FALSE;
+	}
+
+	cursor->fb = mmap(NULL, cursor->mem_info.size,
+	                  PROT_READ | PROT_WRITE, MAP_SHARED, cursor->fd, 0);
+	if (cursor->fb == MAP_FAILED) {
+		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+		           "Mapping cursor memory failed\n");
+		cursor->fb = NULL;
+		return FALSE;
+	}
+
+	if (ioctl(cursor->fd, FBIOGET_VSCREENINFO, &cursor->state_info)) {
+		xf86Msg(X_ERROR, "%s: Reading state info failed\n", __FUNCTION__);
+		return FALSE;
+	}
+	cursor->state_info.xres = OMAPFB_CURSOR_SIZE;
+	cursor->state_info.yres = OMAPFB_CURSOR_SIZE;
+	cursor->state_info.xres_virtual = 0;
+	cursor->state_info.yres_virtual = 0;
+	cursor->state_info.xoffset = 0;
+	cursor->state_info.yoffset = 0;
+	cursor->state_info.rotate = 0;
+	cursor->state_info.grayscale = 0;
+	cursor->state_info.activate = FB_ACTIVATE_NOW;
+	cursor->state_info.bits_per_pixel = 0;
+	cursor->state_info.nonstd = OMAPFB_COLOR_RGB565;
+	if (ioctl(cursor->fd, FBIOPUT_VSCREENINFO, &cursor->state_info)) {
+		xf86Msg(X_ERROR, "%s: setting state info failed\n", __FUNCTION__);
+		return FALSE;
+	}
+
+	cursor->plane_info.pos_x = 0;
+	cursor->plane_info.pos_y = 0;
+	cursor->plane_info.out_width = OMAPFB_CURSOR_SIZE;
+	cursor->plane_info.out_height = OMAPFB_CURSOR_SIZE;
+
+	if (!OMAPFBCursorSetKey(pScrn, cursor))
+		return FALSE;
+
+	memset(cursor->image, 0, sizeof(cursor->image));
+	OMAPFBCursorColorize(cursor);
+	OMAPFBCursorDraw(cursor);
+
+	return TRUE;
+}
+
+static void
+OMAPFBCursorFreeRec(ScrnInfoPtr pScrn)
+{
+	OMAPFBPtr ofb = OMAPFB(pScrn);
+	OMAPFBCursorPtr cursor = ofb->cursor;
+
+	if (cursor->fb)
+		munmap(cursor->fb, cursor->mem_info.size);
+	if (cursor->mem_info.size) {
+		cursor->mem_info.size = 0;
+		ioctl(cursor->fd, OMAPFB_SETUP_MEM, &cursor->mem_info);
+	}
+	if (cursor->fd >= 0)
+		close(cursor->fd);
+	if (cursor->info)
+		xf86DestroyCursorInfoRec(cursor->info);
+
+	xfree(cursor);
+	ofb->cursor = NULL;
+}
+
+/* The LCD channel has a single color key. XV calls this to take it over
+ * for keying video into the graphics, and to give it back. xf86Cursor
+ * only asks UseHWCursor when the cursor changes, so a visible hardware
+ * cursor can't be moved to the sprite from here and keeps the key.
+ * Returns TRUE if the key is free for XV.
+ */
+Bool
+OMAPFBCursorYieldKey(ScrnInfoPtr pScrn, Bool yield)
+{
+	OMAPFBCursorPtr cursor = OMAPFB(pScrn)->cursor;
+	Bool shown;
+
+	if (cursor == NULL)
+		return TRUE;
+	if (cursor->yielded == yield)
+		return TRUE;
+
+	shown = cursor->shown;
+	if (yield) {
+		if (shown)
+			return FALSE;
+		cursor->yielded = TRUE;
+		return TRUE;
+	}
+
+	if (!OMAPFBCursorSetKey(pScrn, cursor))
+		return FALSE;
+	cursor->yielded = FALSE;
+	OMAPFBCursorSetEnabled(pScrn, shown);
+
+	return TRUE;
+}
+
+/* Initialization */
+Bool
+OMAPFBCursorInit(ScreenPtr pScreen)
+{
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	OMAPFBPtr ofb = OMAPFB(pScrn);
+	OMAPFBCursorPtr cursor;
+	xf86CursorInfoPtr info;
+
+	/* External controllers have no free plane, their overlay window is
+	 * used for video
+	 */
+	if (ofb->caps.ctrl & OMAPFB_CAPS_MANUAL_UPDATE) {
+		xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+		           "No spare plane for a hardware cursor on %s\n",
+		           ofb->ctrl_name);
+		return FALSE;
+	}
+
+	cursor = xcalloc(sizeof(OMAPFBCursorRec), 1);
+	if (!cursor)
+		return FALSE;
+	ofb->cursor = cursor;
+
+	cursor->fd = open(OMAP_FBDEV2_NAME, O_RDWR);
+	if (cursor->fd < 0) {
+		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+		           "Failed to open %s: %s\n", OMAP_FBDEV2_NAME,
+		           strerror(errno));
+		OMAPFBCursorFreeRec(pScrn);
+		return FALSE;
+	}
+
+	if (!OMAPFBCursorSetupPlane(pScrn, cursor)) {
+		OMAPFBCursorFreeRec(pScrn);
+		return FALSE;
+	}
+
+	info = cursor->info = xf86CreateCursorInfoRec();
+	if (!info) {
+		OMAPFBCursorFreeRec(pScrn);
+		return FALSE;
+	}
+
+	info->MaxWidth = OMAPFB_CURSOR_SIZE;
+	info->MaxHeight = OMAPFB_CURSOR_SIZE;
+	info->Flags = HARDWARE_CURSOR_UPDATE_UNHIDDEN;
+
+	info->SetCursorColors = OMAPFBSetCursorColors;
+	info->SetCursorPosition = OMAPFBSetCursorPosition;
+	info->LoadCursorImage = OMAPFBLoadCursorImage;
+	info->HideCursor = OMAPFBHideCursor;
+	info->ShowCursor = OMAPFBShowCursor;
+	info->RealizeCursor = OMAPFBRealizeCursor;
+	info->UseHWCursor = OMAPFBUseHWCursor;
+#ifdef ARGB_CURSOR
+	info->UseHWCursorARGB = OMAPFBUseHWCursor;
+	info->LoadCursorARGB = OMAPFBLoadCursorARGB;
+#endif
+
+	if (!xf86InitCursor(pScreen, info)) {
+		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+		           "Hardware cursor initialization failed\n");
+		OMAPFBCursorFreeRec(pScrn);
+		return FALSE;
+	}
+
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO, "Using hardware cursor\n");
+
+	return TRUE;
+}
+
+void
+OMAPFBCursorClose(ScrnInfoPtr pScrn)
+{
+	OMAPFBPtr ofb = OMAPFB(pScrn);
+
+	if (!ofb->cursor)
+		return;
+
+	OMAPFBCursorSetEnabled(pScrn, FALSE);
+	OMAPFBCursorFreeRec(pScrn);
+}
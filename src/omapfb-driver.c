@@ -61,6 +61,9 @@
 #define OMAPFB_DRIVER_NAME "OMAPFB"
 #define OMAPFB_NAME "omapfb"
 
+/* Offscreen memory for EXA pixmaps, in multiples of the screen size */
+#define OMAPFB_OFFSCREEN_SCREENS 2
+
 static Bool OMAPFBProbe(DriverPtr drv, int flags);
 static Bool OMAPFBPreInit(ScrnInfoPtr pScrn, int flags);
 static Bool OMAPFBScreenInit(int scrnIndex, ScreenPtr pScreen, int argc, char **argv);
@@ -88,6 +91,7 @@ OMAPFBFreeRec(ScrnInfoPtr pScrn)
 {
 	if (pScrn->driverPrivate == NULL)
 		return;
+	xfree(OMAPFB(pScrn)->options);
 	xfree(pScrn->driverPrivate);
 	pScrn->driverPrivate = NULL;
 }
@@ -104,11 +108,13 @@ static SymTabRec OMAPFBChipsets[] = {
 typedef enum {
 	OPTION_ACCELMETHOD,
 	OPTION_FB,
+	OPTION_HW_CURSOR,
 } FBDevOpts;
 
 static const OptionInfoRec OMAPFBOptions[] = {
 	{ OPTION_ACCELMETHOD,	"AccelMethod",	OPTV_STRING,	{0},	FALSE },
 	{ OPTION_FB,		"fb",		OPTV_STRING,	{0},	FALSE },
+	{ OPTION_HW_CURSOR,	"HWCursor",	OPTV_BOOLEAN,	{0},	FALSE },
 	{ -1,			NULL,		OPTV_NONE,	{0},	FALSE }
 };
 
@@ -251,10 +257,8 @@ OMAPFBPreInit(ScrnInfoPtr pScrn, int flags)
 {
 	OMAPFBPtr ofb;
 	EntityInfoPtr pEnt;
-	int fd;
 	char *dev;
 	rgb zeros = { 0, 0, 0 };
-	struct omapfb_caps caps;
 	char ctrl_name[32];
 
 	if (flags & PROBE_DETECT) return FALSE;
@@ -294,10 +298,14 @@ OMAPFBPreInit(ScrnInfoPtr pScrn, int flags)
 	/* Try to detect what LCD controller we're using */
 	OMAPFBProbeController(ofb->ctrl_name);
 
-	/* Print out capabilities, if available */
-	if (!ioctl (fd, OMAPFB_GET_CAPS, &caps)) {
-		OMAPFBPrintCapabilities(pScrn, &caps,
+	/* Keep the capabilities for the cursor and print them out, if
+	 * available
+	 */
+	if (!ioctl (ofb->fd, OMAPFB_GET_CAPS, &ofb->caps)) {
+		OMAPFBPrintCapabilities(pScrn, &ofb->caps,
 		                        "Base plane");
+	} else {
+		memset(&ofb->caps, 0, sizeof(ofb->caps));
 	}
 
 	/* Check the memory setup. */
@@ -340,8 +348,11 @@ OMAPFBPreInit(ScrnInfoPtr pScrn, int flags)
 
 /* FIXME: We should allow options for things like overlay framebuffers,
           rotation, etc
-	xf86CollectOptions(pScrn, NULL);
 */
+	xf86CollectOptions(pScrn, NULL);
+	ofb->options = xnfalloc(sizeof(OMAPFBOptions));
+	memcpy(ofb->options, OMAPFBOptions, sizeof(OMAPFBOptions));
+	xf86ProcessOptions(pScrn->scrnIndex, pScrn->options, ofb->options);
 
 	pScrn->progClock = TRUE;
 	pScrn->chipset   = "omapfb";
@@ -417,7 +428,7 @@ OMAPFBXvScreenInit(ScreenPtr pScreen)
 		for (i = 0; i < n; i++) {
 			ptr[i] = generic_adaptors[i];
 		}
-		for (i = n; i < on; i++) {
+		for (i = n; i < n + on; i++) {
 			ptr[i] = omap_adaptors[i-n];
 		}
 		n = n + on;
@@ -436,22 +447,108 @@ OMAPFBCloseScreen(int scrnIndex, ScreenPtr pScreen)
 	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
 	OMAPFBPtr ofb = OMAPFB(pScrn);
 
+	OMAPFBCursorClose(pScrn);
+
 	munmap(ofb->fb, ofb->mem_info.size);
 
+	/* Give back the memory grown for offscreen pixmaps */
+	if (ofb->default_mem_info.size != ofb->mem_info.size) {
+		if (ioctl(ofb->fd, OMAPFB_SETUP_MEM, &ofb->default_mem_info)) {
+			xf86DrvMsg(scrnIndex, X_WARNING,
+			           "Restoring framebuffer memory failed: %s\n",
+			           strerror(errno));
+		} else {
+			ofb->mem_info = ofb->default_mem_info;
+		}
+	}
+
 	pScreen->CloseScreen = ofb->CloseScreen;
 	
 	return (*pScreen->CloseScreen)(scrnIndex, pScreen);
 }
 
+/* Whether the software EXA is built in and not turned off with
+ * Option "AccelMethod" (EXA is the default, "none" disables it)
+ */
+static Bool
+OMAPFBUseExa(ScrnInfoPtr pScrn)
+{
+#ifdef USE_EXA
+	OMAPFBPtr ofb = OMAPFB(pScrn);
+	const char *method = xf86GetOptValString(ofb->options,
+	                                         OPTION_ACCELMETHOD);
+
+	if (method == NULL || !xf86NameCmp(method, "EXA"))
+		return TRUE;
+	if (xf86NameCmp(method, "none"))
+		xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+		           "Unknown AccelMethod \"%s\", acceleration disabled\n",
+		           method);
+#endif
+	return FALSE;
+}
+
+/* Grow the framebuffer memory past the visible screen so that EXA has room
+ * for offscreen pixmaps. If the kernel refuses, whatever the allocation
+ * already has beyond the screen is used.
+ */
+static void
+OMAPFBAllocOffscreenMemory(ScrnInfoPtr pScrn)
+{
+	OMAPFBPtr ofb = OMAPFB(pScrn);
+	struct omapfb_mem_info mem_info;
+	unsigned long page_mask = getpagesize() - 1;
+	unsigned long size;
+
+	ofb->default_mem_info = ofb->mem_info;
+
+	size = ofb->fixed_info.line_length * ofb->state_info.yres_virtual;
+	size = (size * (1 + OMAPFB_OFFSCREEN_SCREENS) + page_mask) & ~page_mask;
+	if (ofb->mem_info.size >= size)
+		return;
+
+	mem_info = ofb->mem_info;
+	mem_info.size = size;
+	if (ioctl(ofb->fd, OMAPFB_SETUP_MEM, &mem_info)) {
+		xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+		           "Growing framebuffer memory to %luKiB failed: %s\n",
+		           size / 1024, strerror(errno));
+		return;
+	}
+
+	/* The line length and memory length must match the new memory */
+	if (ioctl(ofb->fd, FBIOGET_FSCREENINFO, &ofb->fixed_info)) {
+		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+		           "Reading fixed info failed: %s\n", strerror(errno));
+		if (ioctl(ofb->fd, OMAPFB_SETUP_MEM, &ofb->mem_info)) {
+			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+			           "Restoring framebuffer memory failed: %s\n",
+			           strerror(errno));
+		}
+		return;
+	}
+	ofb->mem_info = mem_info;
+
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+	           "Framebuffer memory grown to %iKiB for offscreen pixmaps\n",
+	           ofb->mem_info.size / 1024);
+}
+
 static Bool
 OMAPFBScreenInit(int scrnIndex, ScreenPtr pScreen, int argc, char **argv)
 {
 	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
 	OMAPFBPtr ofb = OMAPFB(pScrn);
+	Bool use_exa = OMAPFBUseExa(pScrn);
 
 	ofb->CloseScreen = pScreen->CloseScreen;
 	pScreen->CloseScreen = OMAPFBCloseScreen;
 
+	if (use_exa)
+		OMAPFBAllocOffscreenMemory(pScrn);
+	else
+		ofb->default_mem_info = ofb->mem_info;
+
 	/* Map our framebuffer memory */
 	ofb->fb = mmap (NULL, ofb->mem_info.size,
 	                PROT_READ | PROT_WRITE, MAP_SHARED,
@@ -518,6 +615,10 @@ OMAPFBScreenInit(int scrnIndex, ScreenPtr pScreen, int argc, char **argv)
 	/* Initialize software cursor */
 	miDCInitialize(pScreen, xf86GetPointerScreenFuncs());
 
+	/* Hardware cursor on a spare plane, the sprite is used otherwise */
+	if (xf86ReturnOptValBool(ofb->options, OPTION_HW_CURSOR, TRUE))
+		OMAPFBCursorInit(pScreen);
+
 	/* Initialize default colormap */
 	if (!miCreateDefColormap(pScreen)) {
 		xf86DrvMsg(scrnIndex, X_ERROR,
@@ -553,7 +654,6 @@ OMAPFBScreenInit(int scrnIndex, ScreenPtr pScreen, int argc, char **argv)
 		           "FBIOBLANK: %s\n", strerror(errno));
 	}
 
-	/* NO-OP currently */
 	pScreen->SaveScreen = OMAPFBSaveScreen;
 	
 	/* Setup DPMS support */
@@ -561,15 +661,15 @@ OMAPFBScreenInit(int scrnIndex, ScreenPtr pScreen, int argc, char **argv)
 	
 #ifdef USE_EXA
 	/* EXA init */
-	xf86LoadSubModule(pScrn, "exa");
-
-	/* TODO: This should depend on the AccelMethod option */
-	ofb->exa = exaDriverAlloc();
-	if (OMAPFBSetupExa(ofb)) {
-		exaDriverInit(pScreen, ofb->exa);
-	} else {
-		xfree(ofb->exa);
-		ofb->exa = NULL;
+	if (use_exa && xf86LoadSubModule(pScrn, "exa")) {
+		ofb->exa = exaDriverAlloc();
+		if (OMAPFBSetupExa(ofb) && exaDriverInit(pScreen, ofb->exa)) {
+			xf86DrvMsg(scrnIndex, X_INFO,
+			           "Using software EXA acceleration\n");
+		} else {
+			xfree(ofb->exa);
+			ofb->exa = NULL;
+		}
 	}
 #endif
 
@@ -703,6 +803,7 @@ OMAPFBDPMSSet(ScrnInfoPtr pScrn, int mode, int flags)
 				xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
 				           "FBIOBLANK: %s\n", strerror(errno));
 			}
+			OMAPFBXVSetBlanked(pScrn, FALSE);
 			break;
 		case DPMSModeStandby:
 		case DPMSModeSuspend:
@@ -712,6 +813,7 @@ OMAPFBDPMSSet(ScrnInfoPtr pScrn, int mode, int flags)
 			 */
 		case DPMSModeOff:
 			/* OMAPFB only supports on and off */
+			OMAPFBXVSetBlanked(pScrn, TRUE);
 			if (ioctl(ofb->fd, FBIOBLANK, (void *)VESA_POWERDOWN)) {
 				xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
 				           "FBIOBLANK: %s\n", strerror(errno));
@@ -788,7 +890,26 @@ OMAPFBLeaveVT(int scrnIndex, int flags)
 static Bool
 OMAPFBSaveScreen(ScreenPtr pScreen, int mode)
 {
-	xf86Msg(X_NOT_IMPLEMENTED, "%s: Dim backlight?\n", __FUNCTION__);
+	ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+	OMAPFBPtr ofb = OMAPFB(pScrn);
+	Bool unblank = xf86IsUnblank(mode);
+
+	if (!pScrn->vtSema)
+		return TRUE;
+
+	/* TODO: Dim backlight instead? */
+	if (!unblank)
+		OMAPFBXVSetBlanked(pScrn, TRUE);
+
+	if (ioctl(ofb->fd, FBIOBLANK, unblank ? (void *)VESA_NO_BLANKING
+	                                      : (void *)VESA_POWERDOWN)) {
+		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+		           "FBIOBLANK: %s\n", strerror(errno));
+	}
+
+	if (unblank)
+		OMAPFBXVSetBlanked(pScrn, FALSE);
+
 	return TRUE;
 }
 
@@ -27,14 +27,21 @@
 #include "xf86.h"
 #include "exa.h"
 #include "xf86xv.h"
+#include "xf86Cursor.h"
 
 #include <linux/fb.h>
 #include "omapfb.h"
 
+struct _OMAPFBXVBackendRec;
+
 /* XV port */
 typedef struct {
 	int fd;
 	unsigned char *fb;
+	/* Length of the mapping at fb, mem_info.size may already have been
+	 * set for the next frame size
+	 */
+	size_t fb_size;
 	/* Non-changeable hardware info */
 	struct fb_fix_screeninfo fixed_info;
 	/* Per-mode state info */
@@ -44,8 +51,90 @@ typedef struct {
 	struct omapfb_plane_info plane_info;
 	struct omapfb_update_window update_window;
 	RegionRec current_clip;
+
+	/* How the controller handles the video plane */
+	const struct _OMAPFBXVBackendRec *backend;
+
+	/* XV_PIXEL_DOUBLE attribute and whether the controller is
+	 * currently doubling the video window
+	 */
+	int pixel_double;
+	Bool pixel_doubled;
+
+	/* The part of the video plane memory (in source pixels) a queued
+	 * manual update may still be reading, empty when none
+	 */
+	BoxRec update_pending;
+
+	/* The gfx plane is disabled under a full screen video */
+	Bool gfx_hidden;
+
+	/* The video plane is disabled, with its memory still mapped, since
+	 * nothing of the video can be shown through current_clip
+	 */
+	Bool plane_hidden;
+
+	/* Complex clips are keyed with colorkey painted into the graphics */
+	INT32 colorkey;
+	Bool colorkey_active;
 } OMAPFBPortRec, *OMAPFBPortPtr;
 
+/* Hardware cursor plane */
+#define OMAPFB_CURSOR_SIZE 64
+
+/* Pixels of a realized 2-color cursor */
+#define OMAPFB_CURSOR_BG 1
+#define OMAPFB_CURSOR_FG 2
+
+typedef struct {
+	int fd;
+	unsigned char *fb;
+	struct fb_var_screeninfo state_info;
+	struct omapfb_mem_info mem_info;
+	struct omapfb_plane_info plane_info;
+	xf86CursorInfoPtr info;
+
+	/* Position of the image inside the plane, non-zero only when the
+	 * cursor is partially off screen
+	 */
+	int offset_x, offset_y;
+
+	/* Realized 2-color cursor and its colors */
+	unsigned char bits[OMAPFB_CURSOR_SIZE * OMAPFB_CURSOR_SIZE];
+	CARD16 fg, bg;
+	Bool argb;
+
+	/* RGB565 image of the current cursor */
+	CARD16 image[OMAPFB_CURSOR_SIZE * OMAPFB_CURSOR_SIZE];
+
+	/* Whether the cursor should be shown, and whether the channel's
+	 * color key has been handed over to XV (new cursors use the sprite
+	 * then)
+	 */
+	Bool shown;
+	Bool yielded;
+} OMAPFBCursorRec, *OMAPFBCursorPtr;
+
+/* Operation prepared by the software EXA hooks */
+typedef struct {
+	unsigned char *dst;
+	int dst_pitch;
+	int bpp;
+	Pixel fg;
+	/* Copy source and direction */
+	unsigned char *src;
+	int src_pitch;
+	int xdir, ydir;
+	/* Composite kernel and source depth */
+	void (*composite)(int w, int h, int src_pitch, int dst_pitch,
+	                  unsigned char *src, unsigned char *dest);
+	int src_bpp;
+	/* Solid color and a8 mask of a masked OVER */
+	CARD32 solid;
+	unsigned char *mask;
+	int mask_pitch;
+} OMAPFBExaStateRec;
+
 typedef struct {
 	int fd;
 	unsigned char *fb;
@@ -56,16 +145,25 @@ typedef struct {
 	struct omapfb_mem_info mem_info;
 	struct omapfb_caps caps;
 	struct omapfb_plane_info plane_info;
+	/* Memory setup before it was grown for offscreen pixmaps */
+	struct omapfb_mem_info default_mem_info;
 
 	/* LCD controller name */
 	char ctrl_name[32];
 	
 	OMAPFBPortPtr port;
+	OMAPFBCursorPtr cursor;
+
+	OptionInfoPtr options;
 
 	CloseScreenProcPtr CloseScreen;
 	DisplayModeRec default_mode;
 
 	ExaDriverPtr exa;
+	OMAPFBExaStateRec exa_state;
+
+	/* The display is blanked, XV frames are dropped until it wakes up */
+	Bool blanked;
 } OMAPFBRec, *OMAPFBPtr;
 
 #define OMAPFB(p) ((OMAPFBPtr)((p)->driverPrivate))
@@ -75,7 +173,11 @@ void OMAPFBPrintCapabilities(ScrnInfoPtr pScrn,
                              const char *plane_name);
 
 Bool OMAPFBSetupExa(OMAPFBPtr ofb);
+Bool OMAPFBCursorInit(ScreenPtr pScreen);
+void OMAPFBCursorClose(ScrnInfoPtr pScrn);
+Bool OMAPFBCursorYieldKey(ScrnInfoPtr pScrn, Bool yield);
 int OMAPFBXVInit (ScrnInfoPtr pScrn, XF86VideoAdaptorPtr **omap_adaptors);
+void OMAPFBXVSetBlanked(ScrnInfoPtr pScrn, Bool blanked);
 
 #endif /* __OMAPFB_DRIVER_H__ */
 
@@ -27,7 +27,8 @@
  *
  * Known features/limitations:
  *  - update window size and position must be divisible by 2 in both directions
- *  -
+ *  - the controller can double the pixels of an update window, which is
+ *    used for video scaled (close to) 2x
  */
 
 #include "xf86.h"
@@ -41,46 +42,67 @@
 #include "omapfb-driver.h"
 #include "omapfb-xv-platform.h"
 
-int OMAPFBXVApplyClip(ScrnInfoPtr pScrn, RegionPtr clipBoxes)
+/* Rows converted and transferred at a time for large frames */
+#define BLIZZARD_STRIP_HEIGHT 64
+
+/* Send the visible part of video plane rows [first, first + rows) to the
+ * controller. The rows are scaled to the plane output size, keeping the
+ * window position and size divisible by 2.
+ */
+static int OMAPFBXVUpdateVideoBlizzard(ScrnInfoPtr pScrn, int first, int rows)
 {
-	double xscale, yscale;
-	int xoffset, yoffset;
-	BoxPtr clip;
+	struct omapfb_update_window w;
 	OMAPFBPtr ofb = OMAPFB(pScrn);
+	const OMAPFBXVBackendRec *b = ofb->port->backend;
+	int top = ofb->port->state_info.yoffset;
+	int bottom = top + ofb->port->state_info.yres;
+	int out_top, out_bottom;
+
+	if (first < top) {
+		rows -= top - first;
+		first = top;
+	}
+	if (first + rows > bottom)
+		rows = bottom - first;
+	if (rows <= 0)
+		return Success;
 
-	/* We can do rectangular clipping directly on the plane, but complex
-	 * clipping would need colorkeying & overlay windows.
-	 */
-	if (REGION_NUM_RECTS(clipBoxes) > 1)
-		return XvBadAlloc;
-
-	clip = REGION_RECTS(clipBoxes);
-
-	/* Calculate scaling factors for source data */
-	xscale = (double)ofb->port->state_info.xres / (double)ofb->port->plane_info.out_width;
-	yscale = (double)ofb->port->state_info.yres / (double)ofb->port->plane_info.out_height;
-	if (xscale > 1.0)
-		xscale = 1.0;
-	if (yscale > 1.0)
-		yscale = 1.0;
+	out_top = OMAPXV_ALIGN((first - top) * ofb->port->plane_info.out_height
+	                       / ofb->port->state_info.yres, b->pos_align);
+	out_bottom = OMAPXV_ALIGN((first + rows - top)
+	                          * ofb->port->plane_info.out_height
+	                          / ofb->port->state_info.yres, b->pos_align);
+	if (first + rows == bottom)
+		out_bottom = ofb->port->plane_info.out_height;
+	if (out_bottom <= out_top)
+		return Success;
 
-	/* First calculate the output values, clipping is expressed in
-	 * destination pixels.
+	w.x = ofb->port->state_info.xoffset;
+	w.y = first;
+	w.width = ofb->port->state_info.xres;
+	w.height = rows;
+	w.format = ofb->port->state_info.nonstd;
+	if (ofb->port->pixel_doubled)
+		w.format |= OMAPFB_FORMAT_FLAG_DOUBLE;
+	/* Let the controller composite the video over the graphics, so a
+	 * single transfer covers the whole video area
 	 */
-	xoffset = clip->x1 - ofb->port->plane_info.pos_x;
-	yoffset = clip->y1 - ofb->port->plane_info.pos_y;
-	ofb->port->plane_info.pos_x = clip->x1 & ~1;
-	ofb->port->plane_info.pos_y = clip->y1 & ~1;
-	ofb->port->plane_info.out_width = (clip->x2 - clip->x1) & ~1;
-	ofb->port->plane_info.out_height = (clip->y2 - clip->y1) & ~1;
-
-	/* Calculate visible plane size and offset (the original source size
-	 * is used as the virtual size
-	 */
-	ofb->port->state_info.xoffset = (int)(xoffset * xscale) & ~1;
-	ofb->port->state_info.yoffset = (int)(yoffset * yscale) & ~1;
-	ofb->port->state_info.xres = (int)(ofb->port->plane_info.out_width * xscale) & ~3;
-	ofb->port->state_info.yres = (int)(ofb->port->plane_info.out_height * yscale) & ~3;
+	if (ofb->port->caps.ctrl & OMAPFB_CAPS_WINDOW_OVERLAY)
+		w.format |= OMAPFB_FORMAT_FLAG_ENABLE_OVERLAY;
+	if (b->tearsync && (ofb->port->caps.ctrl & OMAPFB_CAPS_TEARSYNC))
+		w.format |= OMAPFB_FORMAT_FLAG_TEARSYNC;
+	w.out_x = ofb->port->plane_info.pos_x;
+	w.out_y = ofb->port->plane_info.pos_y + out_top;
+	w.out_width = ofb->port->plane_info.out_width;
+	w.out_height = out_bottom - out_top;
+
+	if (ioctl (ofb->port->fd, OMAPFB_UPDATE_WINDOW, &w))
+	{
+		xf86Msg(X_ERROR, "%s: Failed to update video window:"
+		                 " %s\n", __FUNCTION__, strerror(errno));
+		return XvBadAlloc;
+	}
+	OMAPXVMarkUpdate(pScrn, w.x, w.y, w.width, w.height);
 
 	return Success;
 }
@@ -92,16 +114,20 @@ int OMAPFBXVPutImageBlizzard (ScrnInfoPtr pScrn,
                               int image, char *buf, short width, short height,
                               Bool sync, RegionPtr clipBoxes, pointer data)
 {
-	struct omapfb_update_window w;
 	OMAPFBPtr ofb = OMAPFB(pScrn);
+	const OMAPFBXVBackendRec *b = ofb->port->backend;
+	Bool video_sent = FALSE;
+	OMAPXVSourceRec src;
+	BoxRec visible;
+	int lines;
 	int do_clip = !REGION_EQUAL(pScrn, &ofb->port->current_clip, clipBoxes);
 
-	if (!ofb->port->plane_info.enabled
+	if ((!ofb->port->plane_info.enabled && !ofb->port->plane_hidden)
 	 || ofb->port->update_window.x != src_x
 	 || ofb->port->update_window.y != src_y
 	 || ofb->port->update_window.width != src_w
 	 || ofb->port->update_window.height != src_h
-	 || ofb->port->update_window.format != xv_to_omapfb_format(image)
+	 || ofb->port->update_window.format != OMAPXVPlaneFormat(pScrn, image)
 	 || ofb->port->update_window.out_x != drw_x
 	 || ofb->port->update_window.out_y != drw_y
 	 || ofb->port->update_window.out_width != drw_w
@@ -115,32 +141,15 @@ int OMAPFBXVPutImageBlizzard (ScrnInfoPtr pScrn,
 		ofb->port->update_window.y = src_y;
 	 	ofb->port->update_window.width = src_w;
 	 	ofb->port->update_window.height = src_h;
-	 	ofb->port->update_window.format = xv_to_omapfb_format(image);
+	 	ofb->port->update_window.format = OMAPXVPlaneFormat(pScrn, image);
 	 	ofb->port->update_window.out_x = drw_x;
 	 	ofb->port->update_window.out_y = drw_y;
 	 	ofb->port->update_window.out_width = drw_w;
 	 	ofb->port->update_window.out_height = drw_h;
 
-		if (OUTPUT_IS_OFFSCREEN)
-		{
-			xf86Msg(X_NOT_IMPLEMENTED,
-			        "Partially offscreen video not supported yet\n");
-			/* Stop video... */
-			if (ofb->port->plane_info.enabled) {
-				ofb->port->plane_info.enabled = 0;
-				if (ioctl (ofb->port->fd, OMAPFB_SETUP_PLANE, &ofb->port->plane_info)) {
-					xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-					           "Failed to disable video plane\n");
-				}
-			}
-			/* ..but return Success so that clients don't die
-			 * in case this was just a temprorary thing.
-			 */
-			return Success;
-		}
-
-		/* If we don't have the plane running, enable it */
-		if (!ofb->port->plane_info.enabled) {
+		/* If we don't have the plane memory, allocate it */
+		if (!ofb->port->plane_info.enabled
+		 && !ofb->port->plane_hidden) {
 			ret = OMAPXVAllocPlane(pScrn);
 			if (ret != Success)
 				return ret;
@@ -149,51 +158,64 @@ int OMAPFBXVPutImageBlizzard (ScrnInfoPtr pScrn,
 		/* Set up the state info, xres and yres will be used for
 		 * scaling to the values in the plane info strurct
 		 */
-		ofb->port->state_info.xres = src_w & ~3;
-		ofb->port->state_info.yres = src_h & ~3;
-		ofb->port->state_info.xres_virtual = src_w & ~3;
-		ofb->port->state_info.yres_virtual = src_h & ~3;
+		ofb->port->state_info.xres = OMAPXV_ALIGN(src_w, b->width_align);
+		ofb->port->state_info.yres = OMAPXV_ALIGN(src_h, b->height_align);
+		ofb->port->state_info.xres_virtual = ofb->port->state_info.xres;
+		ofb->port->state_info.yres_virtual = ofb->port->state_info.yres;
 		ofb->port->state_info.xoffset = 0;
 		ofb->port->state_info.yoffset = 0;
 		ofb->port->state_info.rotate = 0;
 		ofb->port->state_info.grayscale = 0;
 		ofb->port->state_info.activate = FB_ACTIVATE_NOW;
 		ofb->port->state_info.bits_per_pixel = 0;
-		ofb->port->state_info.nonstd = xv_to_omapfb_format(image);
+		ofb->port->state_info.nonstd = OMAPXVPlaneFormat(pScrn, image);
 
 		/* Set up the video plane info */
 		ofb->port->plane_info.enabled = 1;
-		ofb->port->plane_info.pos_x = drw_x & ~1;
-		ofb->port->plane_info.pos_y = drw_y & ~1;
-		ofb->port->plane_info.out_width = drw_w & ~1;
-		ofb->port->plane_info.out_height = drw_h & ~1;
-
-		if (do_clip) {
-			REGION_COPY(pScrn, &ofb->port->current_clip, clipBoxes);
-			ret = OMAPFBXVApplyClip(pScrn, clipBoxes);
-			if (ret != Success) {
-				xf86Msg(X_NOT_IMPLEMENTED,
-				        "Complex clipping of video not supported yet\n");
-				/* Stop video... */
-				if (ofb->port->plane_info.enabled) {
-					ofb->port->plane_info.enabled = 0;
-					if (ioctl (ofb->port->fd, OMAPFB_SETUP_PLANE, &ofb->port->plane_info)) {
-						xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
-						           "Failed to disable video plane\n");
-					}
-				}
-				/* ..but return Success so that clients don't die
-				 * in case this was just a temprorary thing.
-				 */
-				return Success;
-			}
+		ofb->port->plane_info.pos_x = OMAPXV_ALIGN(drw_x, b->pos_align);
+		ofb->port->plane_info.pos_y = OMAPXV_ALIGN(drw_y, b->pos_align);
+		ofb->port->plane_info.out_width = OMAPXV_ALIGN(drw_w, b->out_align);
+		ofb->port->plane_info.out_height = OMAPXV_ALIGN(drw_h, b->out_align);
+
+		/* Center the doubled window on the requested output area */
+		ofb->port->pixel_doubled = OMAPXVUsePixelDouble(pScrn,
+		                                                src_w, src_h,
+		                                                drw_w, drw_h);
+		if (ofb->port->pixel_doubled) {
+			int out_w = ofb->port->state_info.xres * 2;
+			int out_h = ofb->port->state_info.yres * 2;
+			int pos_x = drw_x + (drw_w - out_w) / 2;
+			int pos_y = drw_y + (drw_h - out_h) / 2;
+
+			ofb->port->plane_info.pos_x = OMAPXV_ALIGN(pos_x, b->pos_align);
+			ofb->port->plane_info.pos_y = OMAPXV_ALIGN(pos_y, b->pos_align);
+			ofb->port->plane_info.out_width = out_w;
+			ofb->port->plane_info.out_height = out_h;
 		}
 
+		/* The geometry was set up from scratch, clip it again. This
+		 * crops the centered window, not the (possibly larger)
+		 * drawable.
+		 */
+		ret = OMAPFBXVApplyClip(pScrn, clipBoxes);
+		if (ret != Success) {
+			xf86Msg(X_NOT_IMPLEMENTED,
+			        "Complex clipping of video not supported"
+			        " without a color key\n");
+			/* Hide the video until the clip changes, but return
+			 * Success so that clients don't die in case this was
+			 * just a temprorary thing.
+			 */
+			OMAPXVHidePlane(pScrn, clipBoxes);
+			return Success;
+		}
+		ofb->port->plane_hidden = FALSE;
+
 		ret = OMAPXVSetupVideoPlane(pScrn);
 		if (ret != Success)
 			return ret;
 
-		ret = OMAPFB_MANUAL_UPDATE;
+		ret = b->update_mode;
 		if (ioctl (ofb->port->fd, OMAPFB_SET_UPDATE_MODE, &ret))
 		{
 			xf86Msg(X_ERROR, "%s: Failed to set manual update mode:"
@@ -203,104 +225,73 @@ int OMAPFBXVPutImageBlizzard (ScrnInfoPtr pScrn,
 
 	}
 
-	switch (image)
-	{
-		/* Packed formats carry the YUV (luma and 2 chroma values, ie.
-		 * brightness and 2 color description values) packed in
-		 * two-byte macropixels. Each macropixel translates to two
-		 * pixels on screen.
-		 */
-		case FOURCC_UYVY:
-			/* UYVY is packed like this: [U Y1 | V Y2] */
-		case FOURCC_YUY2:
-			/* YUY2 is packed like this: [Y1 U | Y2 V] */
-		{
-			packed_line_copy(src_w & ~3,
-			                 src_h & ~3,
-			                 ((src_w + 1) & ~1) * 2,
-			                 (uint8_t*)buf,
-			                 (uint8_t*)ofb->port->fb);
-			break;
-		}
+	/* Nothing can be seen through this clip */
+	if (ofb->port->plane_hidden)
+		return Success;
 
-		/* Planar formats (as the name says) have the YUV colorspace
-		 * components separated to individual planes. The Y plane is
-		 * full resolution, while the U and V planes are 1/4th (both
-		 * dimensions divided by 2) so a macropixel translates to
-		 * 2x2 pixels on screen
+	/* We don't actually support planar formats, as the blizzard
+	 * has (apparently) due to endianness incompatibilities a
+	 * quirky YUV420 format. Fortunately the conversion to packed
+	 * formats is cheap enough to do smooth 512x288@24fps on N800,
+	 * making support for the "custom" format unattractive. That,
+	 * and the fact that I've tried to use it (there's code around
+	 * to do that conversion) and failed :)
+	 *
+	 * Only the part of the frame that will be seen is converted. We
+	 * don't overwrite rows the controller is still reading, but return
+	 * to the main loop as soon as our updates are queued.
+	 */
+	OMAPXVGetSource(image, buf, width, height, src_x, src_y, &src);
+	OMAPXVVisibleSource(pScrn, &visible);
+	lines = visible.y2 - visible.y1;
+	if (lines >= 2 * BLIZZARD_STRIP_HEIGHT) {
+		BoxRec strip = visible;
+
+		/* Large frames are converted in strips, each finished strip
+		 * is handed to the controller while we convert the next one
+		 * so that the CPU and the bus work in parallel
 		 */
+		for (; strip.y1 < visible.y2; strip.y1 = strip.y2) {
+			strip.y2 = min(strip.y1 + BLIZZARD_STRIP_HEIGHT,
+			               visible.y2);
+
+			if (OMAPXVWaitForUpdate(pScrn, &strip) != Success)
+				return XvBadAlloc;
+			OMAPXVConvertPacked(pScrn, &src, &strip);
+			if (OMAPFBXVUpdateVideoBlizzard(pScrn, strip.y1,
+			                                strip.y2 - strip.y1) != Success)
+				return XvBadAlloc;
+		}
+		video_sent = TRUE;
+	} else {
+		if (OMAPXVWaitForUpdate(pScrn, &visible) != Success)
+			return XvBadAlloc;
+		OMAPXVConvertPacked(pScrn, &src, &visible);
 
-		/* We don't actually support planar formats, as the blizzard
-		 * has (apparently) due to endianness incompatibilities a
-		 * quirky YUV420 format. Fortunately the conversion to packed
-		 * formats is cheap enough to do smooth 512x288@24fps on N800,
-		 * making support for the "custom" format unattractive. That,
-		 * and the fact that I've tried to use it (there's code around
-		 * to do that conversion) and failed :)
+		/* Send the video window by itself if the controller can
+		 * composite it, or if it's doubled (at source resolution,
+		 * the controller doubles it on the way out)
 		 */
-
-		case FOURCC_I420:
-			/* I420 has plane order Y, U, V */
-		{
-			int src_y_pitch = (src_w + 3) & ~3;
-			int src_uv_pitch = (((src_y_pitch >> 1) + 3) & ~3);
-			uint8_t *yb = buf;
-			uint8_t *ub = yb + (src_y_pitch * src_h);
-			uint8_t *vb = ub + (src_uv_pitch * (src_h / 2));
-			uv12_to_uyvy(src_w & ~3,
-			             src_h & ~3,
-			             src_y_pitch,
-			             src_uv_pitch,
-			             yb, ub, vb,
-			             (uint8_t*)ofb->port->fb);
-			break;
+		if ((ofb->port->caps.ctrl & OMAPFB_CAPS_WINDOW_OVERLAY)
+		 || ofb->port->pixel_doubled) {
+			if (OMAPFBXVUpdateVideoBlizzard(pScrn, visible.y1,
+			                                lines) != Success)
+				return XvBadAlloc;
+			video_sent = TRUE;
 		}
-		case FOURCC_YV12:
-			/* YV12 has plane order Y, V, U */
-		{
-			int src_y_pitch = (src_w + 3) & ~3;
-			int src_uv_pitch = (((src_y_pitch >> 1) + 3) & ~3);
-			uint8_t *yb = buf;
-			uint8_t *vb = yb + (src_y_pitch * src_h);
-			uint8_t *ub = vb + (src_uv_pitch * (src_h / 2));
-			uv12_to_uyvy(src_w & ~3,
-			             src_h & ~3,
-			             src_y_pitch,
-			             src_uv_pitch,
-			             yb, ub, vb,
-			             (uint8_t*)ofb->port->fb);
-			break;
-		}
-
-		default:
-			break;
-	}
-
-	w.x = 0;
-	w.y = 0;
-	w.width = ofb->state_info.xres;
-	w.height = ofb->state_info.yres;
-	w.format = 0;
-	w.out_x = 0;
-	w.out_y = 0;
-	w.out_width = ofb->state_info.xres;
-	w.out_height = ofb->state_info.yres;
-
-	if (ioctl (ofb->fd, OMAPFB_UPDATE_WINDOW, &w))
-	{
-		xf86Msg(X_ERROR, "%s: Failed to update screen:"
-		                 " %s\n", __FUNCTION__, strerror(errno));
-		return XvBadAlloc;
 	}
 
-	if (sync) {
-		if (ioctl (ofb->port->fd, OMAPFB_SYNC_GFX))
-		{
-			xf86Msg(X_ERROR, "%s: Graphics sync failed\n", __FUNCTION__);
+	if (video_sent && !ofb->port->colorkey_active) {
+		/* Don't send the graphics under the video */
+		if (OMAPXVUpdateGfxAroundVideo(pScrn) != Success)
+			return XvBadAlloc;
+	} else {
+		if (OMAPXVUpdateGfxRect(pScrn, 0, 0,
+		                        ofb->state_info.xres,
+		                        ofb->state_info.yres) != Success)
 			return XvBadAlloc;
-		}
 	}
-	
+
 	return Success;
 }
 
@@ -313,31 +304,18 @@ int OMAPFBXVStopVideoBlizzard (ScrnInfoPtr pScrn, pointer data, Bool cleanup)
 	if (ofb->port == NULL)
 		return Success;
 
-	if(ofb->port->plane_info.enabled) {
+	/* The key is painted again by the next clipped frame */
+	if (ofb->port->colorkey_active)
+		OMAPXVSetColorKey(pScrn, FALSE);
+	REGION_EMPTY(pScrn->pScreen, &ofb->port->current_clip);
+
+	if (ofb->port->plane_info.enabled || ofb->port->plane_hidden) {
 		int mode;
-		struct omapfb_update_window w;
-		w.x = 0;
-		w.y = 0;
-		w.width = ofb->state_info.xres;
-		w.height = ofb->state_info.yres;
-		w.format = 0;
-		w.out_x = 0;
-		w.out_y = 0;
-		w.out_width = ofb->state_info.xres;
-		w.out_height = ofb->state_info.yres;
-
-		if (ioctl (ofb->port->fd, OMAPFB_SYNC_GFX))
-		{
-			xf86Msg(X_ERROR, "%s: Graphics sync failed\n", __FUNCTION__);
-			return 0;
-		}
 
-		if (ioctl (ofb->fd, OMAPFB_UPDATE_WINDOW, &w))
-		{
-			xf86Msg(X_ERROR, "%s: Failed to update screen:"
-			                 " %s\n", __FUNCTION__, strerror(errno));
+		if (OMAPXVUpdateGfxRect(pScrn, 0, 0,
+		                        ofb->state_info.xres,
+		                        ofb->state_info.yres) != Success)
 			return XvBadAlloc;
-		}
 
 		mode = OMAPFB_AUTO_UPDATE;
 		if (ioctl (ofb->port->fd, OMAPFB_SET_UPDATE_MODE, &mode))
@@ -353,7 +331,9 @@ int OMAPFBXVStopVideoBlizzard (ScrnInfoPtr pScrn, pointer data, Bool cleanup)
 		}
 
 		/* Disable the video plane */
-		munmap(ofb->port->fb, ofb->port->mem_info.size);
+		munmap(ofb->port->fb, ofb->port->fb_size);
+		ofb->port->fb = NULL;
+		ofb->port->plane_hidden = FALSE;
 		ofb->port->plane_info.enabled = 0;
 		if (ioctl (ofb->port->fd, OMAPFB_SETUP_PLANE, &ofb->port->plane_info)) {
 			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
@@ -363,15 +343,13 @@ int OMAPFBXVStopVideoBlizzard (ScrnInfoPtr pScrn, pointer data, Bool cleanup)
 			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
 			           "Failed to query video plane info\n");
 		}
-
-		if (ioctl (ofb->port->fd, OMAPFB_SYNC_GFX))
-		{
-			xf86Msg(X_ERROR, "%s: Graphics sync failed\n", __FUNCTION__);
-			return 0;
-		}
 	}
 
 	if (cleanup == TRUE) {
+		/* The memory is about to be freed */
+		if (OMAPXVWaitForUpdate(pScrn, NULL) != Success)
+			return XvBadAlloc;
+
 		if(ioctl(ofb->port->fd, OMAPFB_QUERY_MEM, &ofb->port->mem_info) != 0) {
 			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
 			           "Failed to fetch memory info\n");
@@ -45,11 +45,15 @@ enum omapfb_color_format xv_to_omapfb_format(int format)
 			return OMAPFB_COLOR_YUY422;
 		case FOURCC_UYVY:
 			return OMAPFB_COLOR_YUV422;
+		case FOURCC_RGB565:
+			return OMAPFB_COLOR_RGB565;
 		case FOURCC_I420:
 		case FOURCC_YV12:
+		case FOURCC_NV12:
+		case FOURCC_NV21:
 			/* Unfortunately dispc doesn't support planar formats
-			 * (at least currently) so we'll need to convert
-			 * to packed (UYVY)
+			 * on most chips so we'll need to convert to packed
+			 * (UYVY), see OMAPXVPlaneFormat for the exceptions
 			 */
 			return OMAPFB_COLOR_YUV422;
 		default:
@@ -58,10 +62,71 @@ enum omapfb_color_format xv_to_omapfb_format(int format)
 	return -1;
 }
 
+/* Pick the plane format for an image on this port, among the formats both
+ * the backend and the plane can take. Packed images keep their byte order
+ * if possible, or are swizzled to the other one. Planar images go to the
+ * plane as they are if it can scan them out, and go to RGB565 on planes
+ * without YUV. RGB565 has no conversion, so -1 is returned if the plane
+ * can't take it.
+ */
+enum omapfb_color_format OMAPXVPlaneFormat(ScrnInfoPtr pScrn, int image)
+{
+	OMAPFBPtr ofb = OMAPFB(pScrn);
+	unsigned int native = ofb->port->backend->native_formats
+	                      & ofb->port->caps.plane_color;
+	enum omapfb_color_format own = xv_to_omapfb_format(image);
+
+	switch (image)
+	{
+		case FOURCC_YUY2:
+		case FOURCC_UYVY:
+			if (native & (1 << own))
+				return own;
+			if (native & (1 << OMAPFB_COLOR_YUY422)
+			 && own == OMAPFB_COLOR_YUV422)
+				return OMAPFB_COLOR_YUY422;
+			if (native & (1 << OMAPFB_COLOR_YUV422)
+			 && own == OMAPFB_COLOR_YUY422)
+				return OMAPFB_COLOR_YUV422;
+			break;
+		case FOURCC_I420:
+		case FOURCC_YV12:
+			if (native & (1 << OMAPFB_COLOR_YUV420))
+				return OMAPFB_COLOR_YUV420;
+			break;
+		case FOURCC_RGB565:
+			/* Either the plane takes it or it can't be shown */
+			if (native & (1 << OMAPFB_COLOR_RGB565))
+				return OMAPFB_COLOR_RGB565;
+			return -1;
+		default:
+			break;
+	}
+
+	if (native & (1 << OMAPFB_COLOR_YUV420))
+		return OMAPFB_COLOR_YUV420;
+
+	/* Without any YUV the video is converted to RGB */
+	if (native == (1 << OMAPFB_COLOR_RGB565))
+		return OMAPFB_COLOR_RGB565;
+
+	return own;
+}
+
 int OMAPXVAllocPlane(ScrnInfoPtr pScrn)
 {
 	OMAPFBPtr ofb = OMAPFB(pScrn);
 
+	/* The old memory might still be read by the controller */
+	if (OMAPXVWaitForUpdate(pScrn, NULL) != Success)
+		return XvBadAlloc;
+
+	/* Don't leave an old mapping behind */
+	if (ofb->port->fb != NULL) {
+		munmap(ofb->port->fb, ofb->port->fb_size);
+		ofb->port->fb = NULL;
+	}
+
 	/* The memory size is already set in OMAPFBXVQueryImageAttributes */
 	if (ioctl(ofb->port->fd, OMAPFB_SETUP_MEM, &ofb->port->mem_info) != 0) {
 		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
@@ -73,11 +138,13 @@ int OMAPXVAllocPlane(ScrnInfoPtr pScrn)
 	ofb->port->fb = mmap (NULL, ofb->port->mem_info.size,
 	                PROT_READ | PROT_WRITE, MAP_SHARED,
 	                ofb->port->fd, 0);
-	if (ofb->port->fb == NULL) {
+	if (ofb->port->fb == MAP_FAILED) {
 		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
 		           "Mapping video memory failed\n");
+		ofb->port->fb = NULL;
 		return XvBadAlloc;
 	}
+	ofb->port->fb_size = ofb->port->mem_info.size;
 
 	/* Update the state info */
 	if (ioctl (ofb->port->fd, FBIOGET_VSCREENINFO, &ofb->port->state_info))
@@ -94,6 +161,10 @@ int OMAPXVSetupVideoPlane(ScrnInfoPtr pScrn)
 {
 	OMAPFBPtr ofb = OMAPFB(pScrn);
 
+	/* The pending updates were queued for the old memory layout */
+	if (OMAPXVWaitForUpdate(pScrn, NULL) != Success)
+		return XvBadAlloc;
+
 	if (ioctl (ofb->port->fd, FBIOPUT_VSCREENINFO, &ofb->port->state_info))
 	{
 	        xf86Msg(X_ERROR, "%s: setting state info failed\n", __FUNCTION__);
@@ -116,6 +187,832 @@ int OMAPXVSetupVideoPlane(ScrnInfoPtr pScrn)
 	return Success;
 }
 
+/* Remember that a queued manual update reads the given part of the video
+ * plane memory
+ */
+void OMAPXVMarkUpdate(ScrnInfoPtr pScrn, int x, int y, int width, int height)
+{
+	OMAPFBPtr ofb = OMAPFB(pScrn);
+	BoxPtr pending = &ofb->port->update_pending;
+
+	if (width <= 0 || height <= 0)
+		return;
+
+	if (pending->x1 >= pending->x2 || pending->y1 >= pending->y2) {
+		pending->x1 = x;
+		pending->y1 = y;
+		pending->x2 = x + width;
+		pending->y2 = y + height;
+		return;
+	}
+	pending->x1 = min(pending->x1, x);
+	pending->y1 = min(pending->y1, y);
+	pending->x2 = max(pending->x2, x + width);
+	pending->y2 = max(pending->y2, y + height);
+}
+
+/* Wait until the controller is done reading the part of the video plane
+ * memory inside the box, or all of it for a NULL box. The kernel only
+ * offers a blocking sync on all queued updates, so we sync only if a
+ * queued one reads memory we are about to overwrite.
+ */
+int OMAPXVWaitForUpdate(ScrnInfoPtr pScrn, BoxPtr box)
+{
+	OMAPFBPtr ofb = OMAPFB(pScrn);
+	BoxPtr pending = &ofb->port->update_pending;
+
+	if (pending->x1 >= pending->x2 || pending->y1 >= pending->y2)
+		return Success;
+	if (box && (box->x1 >= pending->x2 || box->x2 <= pending->x1
+	         || box->y1 >= pending->y2 || box->y2 <= pending->y1))
+		return Success;
+
+	if (ioctl (ofb->port->fd, OMAPFB_SYNC_GFX))
+	{
+		xf86Msg(X_ERROR, "%s: Graphics sync failed\n", __FUNCTION__);
+		return XvBadAlloc;
+	}
+	pending->x1 = pending->x2 = 0;
+	pending->y1 = pending->y2 = 0;
+
+	return Success;
+}
+
+/* Switch the LCD channel between keying the video in where the graphics
+ * have the port's color key and no keying at all. The hardware cursor
+ * uses the same key, so the video only gets it while the cursor is not
+ * on its plane.
+ */
+int OMAPXVSetColorKey(ScrnInfoPtr pScrn, Bool enable)
+{
+	struct omapfb_color_key key;
+	OMAPFBPtr ofb = OMAPFB(pScrn);
+
+	/* Controllers without compositing, or doing their own overlay,
+	 * never show the keyed output
+	 */
+	if (enable && (!ofb->port->backend->colorkey
+	 || (ofb->port->caps.ctrl & OMAPFB_CAPS_WINDOW_OVERLAY)))
+		return XvBadAlloc;
+
+	if (!enable && ofb->cursor) {
+		/* The cursor sets its own key */
+		if (!OMAPFBCursorYieldKey(pScrn, FALSE))
+			return XvBadAlloc;
+		ofb->port->colorkey_active = FALSE;
+		return Success;
+	}
+	if (enable && !OMAPFBCursorYieldKey(pScrn, TRUE))
+		return XvBadAlloc;
+
+	memset(&key, 0, sizeof(key));
+	key.channel_out = OMAPFB_CHANNEL_OUT_LCD;
+	key.key_type = enable ? OMAPFB_COLOR_KEY_GFX_DST
+	                      : OMAPFB_COLOR_KEY_DISABLED;
+	key.trans_key = ofb->port->colorkey;
+
+	if (ioctl(ofb->port->fd, OMAPFB_SET_COLOR_KEY, &key)) {
+		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+		           "Failed to set color key: %s\n", strerror(errno));
+		if (enable)
+			OMAPFBCursorYieldKey(pScrn, FALSE);
+		return XvBadAlloc;
+	}
+	ofb->port->colorkey_active = enable;
+
+	return Success;
+}
+
+/* Shrink the plane to the part inside the box, moving the source offset
+ * and resolution along so the visible video stays where it was. The box
+ * must lie within the plane, the crop never grows it or moves the source
+ * offset back.
+ */
+static void OMAPXVCropPlane(ScrnInfoPtr pScrn, BoxPtr box)
+{
+	double xscale, yscale;
+	int pos_x, pos_y, out_w, out_h, xoffset, yoffset, xres, yres;
+	int src_xalign, src_yalign;
+	OMAPFBPtr ofb = OMAPFB(pScrn);
+	const OMAPFBXVBackendRec *b = ofb->port->backend;
+
+	/* YUV pixels share their chroma in pairs, or in 2x2 blocks for
+	 * YUV420, so the source crop has to start on a whole one
+	 */
+	src_xalign = b->pos_align;
+	src_yalign = b->pos_align;
+	if (ofb->port->state_info.nonstd != OMAPFB_COLOR_RGB565)
+		src_xalign = max(src_xalign, 2);
+	if (ofb->port->state_info.nonstd == OMAPFB_COLOR_YUV420)
+		src_yalign = max(src_yalign, 2);
+
+	/* Source pixels per output pixel, above 1 when downscaling */
+	xscale = (double)ofb->port->state_info.xres / (double)ofb->port->plane_info.out_width;
+	yscale = (double)ofb->port->state_info.yres / (double)ofb->port->plane_info.out_height;
+
+	/* First calculate the output values, clipping is expressed in
+	 * destination pixels.
+	 */
+	pos_x = max(OMAPXV_ALIGN(box->x1, b->pos_align),
+	            (int)ofb->port->plane_info.pos_x);
+	pos_y = max(OMAPXV_ALIGN(box->y1, b->pos_align),
+	            (int)ofb->port->plane_info.pos_y);
+	out_w = min(OMAPXV_ALIGN(box->x2 - pos_x, b->out_align),
+	            (int)ofb->port->plane_info.pos_x
+	            + (int)ofb->port->plane_info.out_width - pos_x);
+	out_h = min(OMAPXV_ALIGN(box->y2 - pos_y, b->out_align),
+	            (int)ofb->port->plane_info.pos_y
+	            + (int)ofb->port->plane_info.out_height - pos_y);
+	xoffset = pos_x - (int)ofb->port->plane_info.pos_x;
+	yoffset = pos_y - (int)ofb->port->plane_info.pos_y;
+
+	/* Calculate visible plane size and offset (the original source size
+	 * is used as the virtual size), on top of any earlier crop and
+	 * within the source
+	 */
+	xoffset = ofb->port->state_info.xoffset
+	          + OMAPXV_ALIGN((int)(xoffset * xscale), src_xalign);
+	yoffset = ofb->port->state_info.yoffset
+	          + OMAPXV_ALIGN((int)(yoffset * yscale), src_yalign);
+	xres = min(OMAPXV_ALIGN((int)(out_w * xscale), b->width_align),
+	           OMAPXV_ALIGN((int)ofb->port->state_info.xres_virtual - xoffset,
+	                        b->width_align));
+	yres = min(OMAPXV_ALIGN((int)(out_h * yscale), b->height_align),
+	           OMAPXV_ALIGN((int)ofb->port->state_info.yres_virtual - yoffset,
+	                        b->height_align));
+	xres = max(min(xres, (int)ofb->port->state_info.xres), 0);
+	yres = max(min(yres, (int)ofb->port->state_info.yres), 0);
+
+	/* The controller doubles exactly what it is given, and a plane that
+	 * can't scale shows the source at its own size
+	 */
+	if (ofb->port->pixel_doubled) {
+		out_w = xres * 2;
+		out_h = yres * 2;
+	} else if (!b->scaling) {
+		out_w = xres;
+		out_h = yres;
+	}
+
+	ofb->port->plane_info.pos_x = pos_x;
+	ofb->port->plane_info.pos_y = pos_y;
+	ofb->port->plane_info.out_width = max(out_w, 0);
+	ofb->port->plane_info.out_height = max(out_h, 0);
+	ofb->port->state_info.xoffset = xoffset;
+	ofb->port->state_info.yoffset = yoffset;
+	ofb->port->state_info.xres = xres;
+	ofb->port->state_info.yres = yres;
+}
+
+/* Limit the visible video to the screen and the clip region. This is
+ * called whenever the plane is set up, the plane geometry must already be
+ * set for the unclipped video. Parts off the screen and a single clip
+ * rectangle are handled by shrinking the plane and cropping the source to
+ * match. For anything more complex, the plane stays on screen as it is
+ * and the video is keyed in where the key color is painted. Without the
+ * key, the video is cropped to the largest visible rectangle.
+ */
+int OMAPFBXVApplyClip(ScrnInfoPtr pScrn, RegionPtr clipBoxes)
+{
+	OMAPFBPtr ofb = OMAPFB(pScrn);
+	ScreenPtr pScreen = pScrn->pScreen;
+	BoxRec screen, box;
+	BoxPtr clip;
+	int x, y, i;
+
+	/* The plane can't extend past the screen edges. The position is
+	 * negative here if the video starts off the top or left edge.
+	 */
+	x = (int)ofb->port->plane_info.pos_x;
+	y = (int)ofb->port->plane_info.pos_y;
+	screen.x1 = max(x, 0);
+	screen.y1 = max(y, 0);
+	screen.x2 = min(x + (int)ofb->port->plane_info.out_width,
+	                (int)ofb->state_info.xres);
+	screen.y2 = min(y + (int)ofb->port->plane_info.out_height,
+	                (int)ofb->state_info.yres);
+	if (screen.x1 >= screen.x2 || screen.y1 >= screen.y2)
+		return XvBadAlloc;
+	if (screen.x1 != x || screen.y1 != y
+	 || screen.x2 - screen.x1 != (int)ofb->port->plane_info.out_width
+	 || screen.y2 - screen.y1 != (int)ofb->port->plane_info.out_height)
+		OMAPXVCropPlane(pScrn, &screen);
+
+	if (REGION_NUM_RECTS(clipBoxes) > 1 && !ofb->port->colorkey_active
+	 && OMAPXVSetColorKey(pScrn, TRUE) == Success)
+		REGION_EMPTY(pScreen, &ofb->port->current_clip);
+
+	if (REGION_NUM_RECTS(clipBoxes) > 1 && ofb->port->colorkey_active) {
+		RegionRec exposed;
+
+		/* The key is still there where the video was visible before */
+		REGION_NULL(pScreen, &exposed);
+		REGION_SUBTRACT(pScreen, &exposed, clipBoxes,
+		                &ofb->port->current_clip);
+		if (REGION_NOTEMPTY(pScreen, &exposed))
+			xf86XVFillKeyHelper(pScreen, ofb->port->colorkey, &exposed);
+		REGION_UNINIT(pScreen, &exposed);
+
+		REGION_COPY(pScreen, &ofb->port->current_clip, clipBoxes);
+		return Success;
+	}
+
+	if (ofb->port->colorkey_active)
+		OMAPXVSetColorKey(pScrn, FALSE);
+	REGION_COPY(pScreen, &ofb->port->current_clip, clipBoxes);
+
+	/* Nothing of the video is visible */
+	if (!REGION_NOTEMPTY(pScreen, clipBoxes))
+		return XvBadAlloc;
+
+	/* The drawable may be larger than the plane when the video is
+	 * centered in it, only the plane itself is cropped
+	 */
+	clip = REGION_RECTS(clipBoxes);
+	x = (int)ofb->port->plane_info.pos_x;
+	y = (int)ofb->port->plane_info.pos_y;
+	box.x1 = box.x2 = box.y1 = box.y2 = 0;
+	for (i = 0; i < REGION_NUM_RECTS(clipBoxes); i++) {
+		BoxRec b;
+
+		b.x1 = max(clip[i].x1, x);
+		b.y1 = max(clip[i].y1, y);
+		b.x2 = min(clip[i].x2, x + (int)ofb->port->plane_info.out_width);
+		b.y2 = min(clip[i].y2, y + (int)ofb->port->plane_info.out_height);
+		if (b.x1 < b.x2 && b.y1 < b.y2
+		 && (b.x2 - b.x1) * (b.y2 - b.y1)
+		    > (box.x2 - box.x1) * (box.y2 - box.y1))
+			box = b;
+	}
+	if (box.x1 >= box.x2 || box.y1 >= box.y2)
+		return XvBadAlloc;
+	if (box.x1 != x || box.y1 != y
+	 || box.x2 - box.x1 != (int)ofb->port->plane_info.out_width
+	 || box.y2 - box.y1 != (int)ofb->port->plane_info.out_height)
+		OMAPXVCropPlane(pScrn, &box);
+
+	if (ofb->port->state_info.xres == 0 || ofb->port->state_info.yres == 0
+	 || ofb->port->plane_info.out_width == 0
+	 || ofb->port->plane_info.out_height == 0)
+		return XvBadAlloc;
+
+	return Success;
+}
+
+/* Decide whether the controller should double the video pixels. Doubled
+ * windows only carry a quarter of the data over the bus, so we use it
+ * whenever the requested output is within 1/8th of twice the source size.
+ */
+Bool OMAPXVUsePixelDouble(ScrnInfoPtr pScrn,
+                          short src_w, short src_h,
+                          short drw_w, short drw_h)
+{
+	OMAPFBPtr ofb = OMAPFB(pScrn);
+	const OMAPFBXVBackendRec *b = ofb->port->backend;
+	int out_w = OMAPXV_ALIGN(src_w, b->width_align) * 2;
+	int out_h = OMAPXV_ALIGN(src_h, b->height_align) * 2;
+
+	if (!(ofb->port->caps.ctrl & OMAPFB_CAPS_WINDOW_PIXEL_DOUBLE))
+		return FALSE;
+	if (ofb->port->pixel_double == OMAPFB_PIXEL_DOUBLE_OFF)
+		return FALSE;
+
+	/* The doubled window must fit on the screen */
+	if (out_w > ofb->state_info.xres || out_h > ofb->state_info.yres)
+		return FALSE;
+
+	if (ofb->port->pixel_double == OMAPFB_PIXEL_DOUBLE_ON)
+		return TRUE;
+
+	return abs(out_w - drw_w) <= drw_w / 8
+	    && abs(out_h - drw_h) <= drw_h / 8;
+}
+
+/* Update a rectangle of the graphics plane */
+int OMAPXVUpdateGfxRect(ScrnInfoPtr pScrn, int x, int y, int width, int height)
+{
+	struct omapfb_update_window w;
+	OMAPFBPtr ofb = OMAPFB(pScrn);
+
+	if (width <= 0 || height <= 0)
+		return Success;
+
+	w.x = x;
+	w.y = y;
+	w.width = width;
+	w.height = height;
+	w.format = 0;
+	w.out_x = x;
+	w.out_y = y;
+	w.out_width = width;
+	w.out_height = height;
+
+	if (ioctl (ofb->fd, OMAPFB_UPDATE_WINDOW, &w))
+	{
+		xf86Msg(X_ERROR, "%s: Failed to update screen:"
+		                 " %s\n", __FUNCTION__, strerror(errno));
+		return XvBadAlloc;
+	}
+	/* The controller composites the video plane into the part of the
+	 * window it covers, reading that part of the plane memory too
+	 */
+	if (ofb->port->plane_info.enabled) {
+		int pos_x = (int)ofb->port->plane_info.pos_x;
+		int pos_y = (int)ofb->port->plane_info.pos_y;
+		int out_w = ofb->port->plane_info.out_width;
+		int out_h = ofb->port->plane_info.out_height;
+		int x1 = max(x, pos_x) - pos_x;
+		int y1 = max(y, pos_y) - pos_y;
+		int x2 = min(x + width, pos_x + out_w) - pos_x;
+		int y2 = min(y + height, pos_y + out_h) - pos_y;
+
+		if (x1 < x2 && y1 < y2) {
+			int xres = ofb->port->state_info.xres;
+			int yres = ofb->port->state_info.yres;
+
+			/* Scale to source pixels, rounding outwards */
+			x1 = x1 * xres / out_w;
+			y1 = y1 * yres / out_h;
+			x2 = (x2 * xres + out_w - 1) / out_w;
+			y2 = (y2 * yres + out_h - 1) / out_h;
+			OMAPXVMarkUpdate(pScrn,
+			                 ofb->port->state_info.xoffset + x1,
+			                 ofb->port->state_info.yoffset + y1,
+			                 x2 - x1, y2 - y1);
+		}
+	}
+
+	return Success;
+}
+
+/* Update the graphics around the video window on manual update
+ * controllers. The pixels under the video have already been sent with
+ * it, so only the (up to four) bands surrounding it need a refresh.
+ */
+int OMAPXVUpdateGfxAroundVideo(ScrnInfoPtr pScrn)
+{
+	OMAPFBPtr ofb = OMAPFB(pScrn);
+	int xres = ofb->state_info.xres;
+	int yres = ofb->state_info.yres;
+	int x1 = ofb->port->plane_info.pos_x;
+	int y1 = ofb->port->plane_info.pos_y;
+	int x2 = x1 + ofb->port->plane_info.out_width;
+	int y2 = y1 + ofb->port->plane_info.out_height;
+
+	if (x2 > xres)
+		x2 = xres;
+	if (y2 > yres)
+		y2 = yres;
+
+	if (OMAPXVUpdateGfxRect(pScrn, 0, 0, xres, y1) != Success
+	 || OMAPXVUpdateGfxRect(pScrn, 0, y2, xres, yres - y2) != Success
+	 || OMAPXVUpdateGfxRect(pScrn, 0, y1, x1, y2 - y1) != Success
+	 || OMAPXVUpdateGfxRect(pScrn, x2, y1, xres - x2, y2 - y1) != Success)
+		return XvBadAlloc;
+
+	return Success;
+}
+
+/* Stop scanning out the graphics plane while the video plane covers all
+ * of the screen and no window is on top of it, and bring it back as soon
+ * as that no longer holds. Pass a NULL clip when the video is stopped.
+ */
+int OMAPXVUpdateGfxPlane(ScrnInfoPtr pScrn, RegionPtr clipBoxes)
+{
+	OMAPFBPtr ofb = OMAPFB(pScrn);
+	const OMAPFBXVBackendRec *b = ofb->port->backend;
+	Bool covered = FALSE;
+
+	/* The plane output size is aligned down, so on screens that aren't
+	 * a multiple of the alignment it can't reach the far edges. Those
+	 * few pixels are left to the background color.
+	 */
+	if (clipBoxes && ofb->port->plane_info.enabled
+	 && ofb->port->plane_info.pos_x == 0
+	 && ofb->port->plane_info.pos_y == 0
+	 && ofb->port->plane_info.out_width
+	    >= OMAPXV_ALIGN(ofb->state_info.xres, b->out_align)
+	 && ofb->port->plane_info.out_height
+	    >= OMAPXV_ALIGN(ofb->state_info.yres, b->out_align)
+	 && REGION_NUM_RECTS(clipBoxes) == 1) {
+		BoxPtr box = REGION_EXTENTS(pScrn, clipBoxes);
+
+		covered = box->x1 <= 0 && box->y1 <= 0
+		       && box->x2 >= ofb->state_info.xres
+		       && box->y2 >= ofb->state_info.yres;
+	}
+
+	if (covered == ofb->port->gfx_hidden)
+		return Success;
+
+	ofb->plane_info.enabled = !covered;
+	if (ioctl(ofb->fd, OMAPFB_SETUP_PLANE, &ofb->plane_info)) {
+		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+		           "Failed to %s graphics plane: %s\n",
+		           covered ? "disable" : "enable", strerror(errno));
+		ofb->plane_info.enabled = covered;
+		return XvBadAlloc;
+	}
+	ofb->port->gfx_hidden = covered;
+
+	return Success;
+}
+
+/* Hide the video plane when nothing of it can be shown with this clip.
+ * The memory stays mapped and the clip is remembered, so following frames
+ * with the same clip and geometry are dropped without touching the plane.
+ */
+void OMAPXVHidePlane(ScrnInfoPtr pScrn, RegionPtr clipBoxes)
+{
+	OMAPFBPtr ofb = OMAPFB(pScrn);
+	const OMAPFBXVBackendRec *b = ofb->port->backend;
+
+	REGION_COPY(pScrn->pScreen, &ofb->port->current_clip, clipBoxes);
+	if (ofb->port->plane_hidden)
+		return;
+	ofb->port->plane_hidden = TRUE;
+
+	if (ofb->port->colorkey_active)
+		OMAPXVSetColorKey(pScrn, FALSE);
+	OMAPXVUpdateGfxPlane(pScrn, NULL);
+
+	/* Disable the plane as the hardware has it, the geometry set up for
+	 * this frame may not be valid
+	 */
+	if (ioctl (ofb->port->fd, OMAPFB_QUERY_PLANE, &ofb->port->plane_info)) {
+		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+		           "Failed to query video plane info\n");
+	}
+	ofb->port->plane_info.enabled = 0;
+	if (ioctl (ofb->port->fd, OMAPFB_SETUP_PLANE, &ofb->port->plane_info)) {
+		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+		           "Failed to disable video plane\n");
+	}
+
+	/* Nothing sends the graphics to a manual update panel while no
+	 * frames are shown
+	 */
+	if (b->update_mode == OMAPFB_MANUAL_UPDATE) {
+		int mode = OMAPFB_AUTO_UPDATE;
+
+		OMAPXVUpdateGfxRect(pScrn, 0, 0,
+		                    ofb->state_info.xres, ofb->state_info.yres);
+		if (ioctl (ofb->port->fd, OMAPFB_SET_UPDATE_MODE, &mode))
+		{
+			xf86Msg(X_ERROR, "%s: Failed to set auto update mode:"
+			                 " %s\n", __FUNCTION__, strerror(errno));
+		}
+	}
+}
+
+/* Lay out an image of the given size the way clients must pass it to
+ * PutImage, returns the image size
+ */
+int OMAPXVImageLayout(int id, int width, int height,
+                      int *pitches, int *offsets)
+{
+	int w = width;
+	int h = height;
+	int size = 0;
+	int tmp = 0;
+
+	if (offsets)
+		offsets[0] = 0;
+
+	switch (id)
+	{
+		case FOURCC_I420:
+		case FOURCC_YV12:
+			w = (w + 3) & ~3;
+			h = (h + 1) & ~1;
+			size = w;
+			if (pitches)
+				pitches[0] = size;
+			size *= h;
+			if (offsets)
+				offsets[1] = size;
+			tmp = w >> 1;
+			tmp = (tmp + 3) & ~3;
+			if (pitches)
+				pitches[1] = pitches[2] = tmp;
+			tmp *= h >> 1;
+			size += tmp;
+			if (offsets)
+				offsets[2] = size;
+			size += tmp;
+			break;
+		case FOURCC_NV12:
+		case FOURCC_NV21:
+			/* The chroma pairs share a plane as wide as the luma */
+			w = (w + 3) & ~3;
+			h = (h + 1) & ~1;
+			size = w;
+			if (pitches)
+				pitches[0] = pitches[1] = size;
+			size *= h;
+			if (offsets)
+				offsets[1] = size;
+			size += w * (h >> 1);
+			break;
+		case FOURCC_UYVY:
+		case FOURCC_YUY2:
+		default:
+			w = (w + 1) & ~1;
+			size = w << 1;
+			if (pitches)
+				pitches[0] = size;
+			size *= h;
+			break;
+	}
+
+	return size;
+}
+
+/* Locate the planes of a client image. The source origin is rounded down
+ * to whole 2x2 blocks, so chroma stays aligned for every format.
+ */
+void OMAPXVGetSource(int image, char *buf, short width, short height,
+                     short src_x, short src_y, OMAPXVSourcePtr src)
+{
+	int offsets[3];
+	int i;
+
+	memset(src, 0, sizeof(OMAPXVSourceRec));
+	OMAPXVImageLayout(image, width, height, src->pitches, offsets);
+
+	src->id = image;
+	src->x = src_x & ~1;
+	src->y = src_y & ~1;
+	src->planes[0] = (uint8_t*)buf;
+
+	switch (image)
+	{
+		case FOURCC_I420:
+			/* I420 has plane order Y, U, V */
+			for (i = 1; i < 3; i++)
+				src->planes[i] = (uint8_t*)buf + offsets[i];
+			break;
+		case FOURCC_YV12:
+			/* YV12 has plane order Y, V, U */
+			src->planes[1] = (uint8_t*)buf + offsets[2];
+			src->planes[2] = (uint8_t*)buf + offsets[1];
+			break;
+		case FOURCC_NV12:
+		case FOURCC_NV21:
+			/* Interleaved chroma in a single plane */
+			src->planes[1] = (uint8_t*)buf + offsets[1];
+			break;
+		default:
+			break;
+	}
+}
+
+/* Find the part of the plane memory that shows up on screen. The box is
+ * widened to whole 2x2 blocks so that 4:2:0 chroma can be converted for
+ * it directly.
+ */
+void OMAPXVVisibleSource(ScrnInfoPtr pScrn, BoxPtr box)
+{
+	OMAPFBPtr ofb = OMAPFB(pScrn);
+	struct fb_var_screeninfo *v = &ofb->port->state_info;
+
+	box->x1 = v->xoffset & ~1;
+	box->y1 = v->yoffset & ~1;
+	box->x2 = min((int)((v->xoffset + v->xres + 1) & ~1), (int)v->xres_virtual);
+	box->y2 = min((int)((v->yoffset + v->yres + 1) & ~1), (int)v->yres_virtual);
+}
+
+/* Convert the box of the source image into the same place in the packed
+ * 4:2:2 (or RGB565) plane memory
+ */
+void OMAPXVConvertPacked(ScrnInfoPtr pScrn, OMAPXVSourcePtr src, BoxPtr box)
+{
+	OMAPFBPtr ofb = OMAPFB(pScrn);
+	int pitch = ofb->port->state_info.xres_virtual * 2;
+	int x = src->x + box->x1;
+	int y = src->y + box->y1;
+	int w = box->x2 - box->x1;
+	int h = box->y2 - box->y1;
+	uint8_t *dest = (uint8_t*)ofb->port->fb + box->y1 * pitch + box->x1 * 2;
+
+	if (w <= 0 || h <= 0)
+		return;
+
+	switch (src->id)
+	{
+		/* Packed formats carry the YUV (luma and 2 chroma values, ie.
+		 * brightness and 2 color description values) packed in
+		 * two-byte macropixels. Each macropixel translates to two
+		 * pixels on screen. The plane may take the other byte order,
+		 * which only needs the bytes of each pair swapped.
+		 */
+		case FOURCC_UYVY:
+			/* UYVY is packed like this: [U Y1 | V Y2] */
+		case FOURCC_YUY2:
+			/* YUY2 is packed like this: [Y1 U | Y2 V] */
+			if (ofb->port->state_info.nonstd == xv_to_omapfb_format(src->id))
+				packed_line_copy(w,
+				                 h,
+				                 src->pitches[0],
+				                 pitch,
+				                 src->planes[0] + y * src->pitches[0] + x * 2,
+				                 dest);
+			else
+				packed_swap_copy(w,
+				                 h,
+				                 src->pitches[0],
+				                 pitch,
+				                 src->planes[0] + y * src->pitches[0] + x * 2,
+				                 dest);
+			break;
+
+		/* RGB565 only needs copying, the plane does any scaling */
+		case FOURCC_RGB565:
+			packed_line_copy(w,
+			                 h,
+			                 src->pitches[0],
+			                 pitch,
+			                 src->planes[0] + y * src->pitches[0] + x * 2,
+			                 dest);
+			break;
+
+		/* Planar formats (as the name says) have the YUV colorspace
+		 * components separated to individual planes. The Y plane is
+		 * full resolution, while the U and V planes are 1/4th (both
+		 * dimensions divided by 2) so a macropixel translates to
+		 * 2x2 pixels on screen
+		 */
+		case FOURCC_I420:
+		case FOURCC_YV12:
+			uv12_to_uyvy(w,
+			             h,
+			             src->pitches[0],
+			             src->pitches[1],
+			             pitch,
+			             src->planes[0] + y * src->pitches[0] + x,
+			             src->planes[1] + (y / 2) * src->pitches[1] + x / 2,
+			             src->planes[2] + (y / 2) * src->pitches[2] + x / 2,
+			             dest);
+			break;
+
+		/* Semi-planar formats have the U and V planes interleaved
+		 * into one, at the same resolution as for the planar ones
+		 */
+		case FOURCC_NV12:
+			/* NV12 has chroma pairs [U V] */
+			nv12_to_uyvy(w,
+			             h,
+			             src->pitches[0],
+			             src->pitches[1],
+			             pitch,
+			             src->planes[0] + y * src->pitches[0] + x,
+			             src->planes[1] + (y / 2) * src->pitches[1] + x,
+			             dest);
+			break;
+		case FOURCC_NV21:
+			/* NV21 has chroma pairs [V U] */
+			nv21_to_uyvy(w,
+			             h,
+			             src->pitches[0],
+			             src->pitches[1],
+			             pitch,
+			             src->planes[0] + y * src->pitches[0] + x,
+			             src->planes[1] + (y / 2) * src->pitches[1] + x,
+			             dest);
+			break;
+		default:
+			break;
+	}
+}
+
+/* Convert the box of the source image into the same place in the planar
+ * YUV420 plane memory, the box must be aligned to 2x2 blocks
+ */
+void OMAPXVConvertPlanar(ScrnInfoPtr pScrn, OMAPXVSourcePtr src, BoxPtr box)
+{
+	OMAPFBPtr ofb = OMAPFB(pScrn);
+	int pitch = ofb->port->state_info.xres_virtual;
+	int lines = ofb->port->state_info.yres_virtual;
+	int x = src->x + box->x1;
+	int y = src->y + box->y1;
+	int w = box->x2 - box->x1;
+	int h = box->y2 - box->y1;
+	int uv_offset = (box->y1 / 2) * (pitch / 2) + box->x1 / 2;
+	uint8_t *y_dest = (uint8_t*)ofb->port->fb;
+	uint8_t *u_dest = y_dest + pitch * lines;
+	uint8_t *v_dest = u_dest + (pitch / 2) * (lines / 2);
+
+	if (w <= 0 || h <= 0)
+		return;
+
+	y_dest += box->y1 * pitch + box->x1;
+	u_dest += uv_offset;
+	v_dest += uv_offset;
+
+	switch (src->id)
+	{
+		case FOURCC_UYVY:
+			/* UYVY is packed like this: [U Y1 | V Y2] */
+			packed_to_uv12(w, h, src->pitches[0], pitch, 1, 0, 2,
+			               src->planes[0] + y * src->pitches[0] + x * 2,
+			               y_dest, u_dest, v_dest);
+			break;
+		case FOURCC_YUY2:
+			/* YUY2 is packed like this: [Y1 U | Y2 V] */
+			packed_to_uv12(w, h, src->pitches[0], pitch, 0, 1, 3,
+			               src->planes[0] + y * src->pitches[0] + x * 2,
+			               y_dest, u_dest, v_dest);
+			break;
+
+		/* Planar sources only need their planes re-pitched */
+		case FOURCC_I420:
+		case FOURCC_YV12:
+			uv12_copy(w, h, src->pitches[0], src->pitches[1], pitch,
+			          src->planes[0] + y * src->pitches[0] + x,
+			          src->planes[1] + (y / 2) * src->pitches[1] + x / 2,
+			          src->planes[2] + (y / 2) * src->pitches[2] + x / 2,
+			          y_dest, u_dest, v_dest);
+			break;
+
+		/* Semi-planar chroma is split into the two planes */
+		case FOURCC_NV12:
+		case FOURCC_NV21:
+			nv_to_uv12(w, h, src->pitches[0], src->pitches[1], pitch,
+			           src->id == FOURCC_NV12 ? 0 : 1,
+			           src->id == FOURCC_NV12 ? 1 : 0,
+			           src->planes[0] + y * src->pitches[0] + x,
+			           src->planes[1] + (y / 2) * src->pitches[1] + x,
+			           y_dest, u_dest, v_dest);
+			break;
+
+		default:
+			break;
+	}
+}
+
+/* Convert a box of the source to an RGB565 plane, for planes and
+ * controllers that take no YUV layout we can write
+ */
+void OMAPXVConvertRGB565(ScrnInfoPtr pScrn, OMAPXVSourcePtr src, BoxPtr box)
+{
+	OMAPFBPtr ofb = OMAPFB(pScrn);
+	int pitch = ofb->port->state_info.xres_virtual * 2;
+	int x = src->x + box->x1;
+	int w = box->x2 - box->x1;
+	int y;
+	uint8_t *dest = (uint8_t*)ofb->port->fb + box->y1 * pitch + box->x1 * 2;
+
+	if (w <= 0)
+		return;
+
+	if (src->id == FOURCC_RGB565) {
+		OMAPXVConvertPacked(pScrn, src, box);
+		return;
+	}
+
+	for (y = src->y + box->y1; y < src->y + box->y2; y++, dest += pitch) {
+		uint8_t *line = src->planes[0] + y * src->pitches[0];
+		uint8_t *uv = NULL;
+
+		/* Planar chroma has half the lines */
+		if (src->planes[1])
+			uv = src->planes[1] + (y / 2) * src->pitches[1];
+
+		switch (src->id)
+		{
+			case FOURCC_UYVY:
+				/* [U Y1 | V Y2] */
+				yuv_line_to_rgb565(w, x, 2, 4, line + 1,
+				                   line, line + 2,
+				                   (uint16_t*)dest);
+				break;
+			case FOURCC_YUY2:
+				/* [Y1 U | Y2 V] */
+				yuv_line_to_rgb565(w, x, 2, 4, line,
+				                   line + 1, line + 3,
+				                   (uint16_t*)dest);
+				break;
+			case FOURCC_I420:
+			case FOURCC_YV12:
+				yuv_line_to_rgb565(w, x, 1, 1, line, uv,
+				                   src->planes[2]
+				                   + (y / 2) * src->pitches[2],
+				                   (uint16_t*)dest);
+				break;
+			case FOURCC_NV12:
+				yuv_line_to_rgb565(w, x, 1, 2, line, uv, uv + 1,
+				                   (uint16_t*)dest);
+				break;
+			case FOURCC_NV21:
+				yuv_line_to_rgb565(w, x, 1, 2, line, uv + 1, uv,
+				                   (uint16_t*)dest);
+				break;
+			default:
+				return;
+		}
+	}
+}
+
 int OMAPFBXVPutImageGeneric (ScrnInfoPtr pScrn,
                              short src_x, short src_y, short drw_x, short drw_y,
                              short src_w, short src_h, short drw_w, short drw_h,
@@ -123,17 +1020,24 @@ int OMAPFBXVPutImageGeneric (ScrnInfoPtr pScrn,
                              Bool sync, RegionPtr clipBoxes, pointer data)
 {
 	OMAPFBPtr ofb = OMAPFB(pScrn);
+	const OMAPFBXVBackendRec *b = ofb->port->backend;
+	int w = OMAPXV_ALIGN(src_w, b->width_align);
+	int h = OMAPXV_ALIGN(src_h, b->height_align);
+	OMAPXVSourceRec src;
+	BoxRec visible;
+	int do_clip = !REGION_EQUAL(pScrn, &ofb->port->current_clip, clipBoxes);
 
-	if (!ofb->port->plane_info.enabled
+	if ((!ofb->port->plane_info.enabled && !ofb->port->plane_hidden)
 	 || ofb->port->update_window.x != src_x
 	 || ofb->port->update_window.y != src_y
 	 || ofb->port->update_window.width != src_w
 	 || ofb->port->update_window.height != src_h
-	 || ofb->port->update_window.format != xv_to_omapfb_format(image)
+	 || ofb->port->update_window.format != OMAPXVPlaneFormat(pScrn, image)
 	 || ofb->port->update_window.out_x != drw_x
 	 || ofb->port->update_window.out_y != drw_y
 	 || ofb->port->update_window.out_width != drw_w
-	 || ofb->port->update_window.out_height != drw_h)
+	 || ofb->port->update_window.out_height != drw_h
+	 || do_clip)
 	{
 		int ret;
 		
@@ -142,28 +1046,15 @@ int OMAPFBXVPutImageGeneric (ScrnInfoPtr pScrn,
 		ofb->port->update_window.y = src_y;
 	 	ofb->port->update_window.width = src_w;
 	 	ofb->port->update_window.height = src_h;
-	 	ofb->port->update_window.format = xv_to_omapfb_format(image);
+	 	ofb->port->update_window.format = OMAPXVPlaneFormat(pScrn, image);
 	 	ofb->port->update_window.out_x = drw_x;
 	 	ofb->port->update_window.out_y = drw_y;
 	 	ofb->port->update_window.out_width = drw_w;
 	 	ofb->port->update_window.out_height = drw_h;
 
-		if (OUTPUT_IS_OFFSCREEN)
-		{
-			xf86Msg(X_NOT_IMPLEMENTED,
-			        "Partially offscreen video not supported yet\n");
-			/* Stop video... */
-			if (ofb->port->plane_info.enabled) {
-				OMAPFBXVStopVideoBlizzard(pScrn, NULL, FALSE);
-			}
-			/* ..but return Success so that clients don't die
-			 * in case this was just a temprorary thing.
-			 */
-			return Success;
-		}
-
-		/* If we don't have the plane running, enable it */
-		if (!ofb->port->plane_info.enabled) {
+		/* If we don't have the plane memory, allocate it */
+		if (!ofb->port->plane_info.enabled
+		 && !ofb->port->plane_hidden) {
 			ret = OMAPXVAllocPlane(pScrn);
 			if (ret != Success)
 				return ret;
@@ -172,34 +1063,39 @@ int OMAPFBXVPutImageGeneric (ScrnInfoPtr pScrn,
 		/* Set up the state info, xres and yres will be used for
 		 * scaling to the values in the plane info struct
 		 */
-		ofb->port->state_info.xres = src_w & ~15;
-		ofb->port->state_info.yres = src_h & ~15;
-		ofb->port->state_info.xres_virtual = 0;
-		ofb->port->state_info.yres_virtual = 0;
+		ofb->port->state_info.xres = w;
+		ofb->port->state_info.yres = h;
+		ofb->port->state_info.xres_virtual = w;
+		ofb->port->state_info.yres_virtual = h;
 		ofb->port->state_info.xoffset = 0;
 		ofb->port->state_info.yoffset = 0;
 		ofb->port->state_info.rotate = 0;
 		ofb->port->state_info.grayscale = 0;
 		ofb->port->state_info.activate = FB_ACTIVATE_NOW;
 		ofb->port->state_info.bits_per_pixel = 0;
-		ofb->port->state_info.nonstd = xv_to_omapfb_format(image);
+		ofb->port->state_info.nonstd = OMAPXVPlaneFormat(pScrn, image);
 
 		/* Set up the video plane info */
 		ofb->port->plane_info.enabled = 1;
 		ofb->port->plane_info.pos_x = drw_x;
 		ofb->port->plane_info.pos_y = drw_y;
-		ofb->port->plane_info.out_width = drw_w & ~15;
-		ofb->port->plane_info.out_height = drw_h & ~15;
+		ofb->port->plane_info.out_width = OMAPXV_ALIGN(drw_w, b->out_align);
+		ofb->port->plane_info.out_height = OMAPXV_ALIGN(drw_h, b->out_align);
 
-		/* Cap output to screen size */
-		if (ofb->port->plane_info.out_width > ofb->state_info.xres) {
-			ofb->port->plane_info.pos_x = 0;
-			ofb->port->plane_info.out_width = ofb->state_info.xres;
-		}
-		if (ofb->port->plane_info.out_height > ofb->state_info.yres) {
-			ofb->port->plane_info.pos_y = 0;
-			ofb->port->plane_info.out_height = ofb->state_info.yres;
+		/* The geometry was set up from scratch, clip it again */
+		ret = OMAPFBXVApplyClip(pScrn, clipBoxes);
+		if (ret != Success) {
+			xf86Msg(X_NOT_IMPLEMENTED,
+			        "Complex clipping of video not supported"
+			        " without a color key\n");
+			/* Hide the video until the clip changes, but return
+			 * Success so that clients don't die in case this was
+			 * just a temprorary thing.
+			 */
+			OMAPXVHidePlane(pScrn, clipBoxes);
+			return Success;
 		}
+		ofb->port->plane_hidden = FALSE;
 
 		ret = OMAPXVSetupVideoPlane(pScrn);
 		if (ret != Success)
@@ -207,76 +1103,23 @@ int OMAPFBXVPutImageGeneric (ScrnInfoPtr pScrn,
 
 	}
 
-	switch (image)
-	{
-		/* Packed formats carry the YUV (luma and 2 chroma values, ie.
-		 * brightness and 2 color description values) packed in
-		 * two-byte macropixels. Each macropixel translates to two
-		 * pixels on screen.
-		 */
-		case FOURCC_UYVY:
-			/* UYVY is packed like this: [U Y1 | V Y2] */
-		case FOURCC_YUY2:
-			/* YUY2 is packed like this: [Y1 U | Y2 V] */
-		{
-			packed_line_copy(src_w & ~15,
-			                 src_h & ~15,
-			                 ((src_w + 1) & ~1) * 2,
-			                 (uint8_t*)buf,
-			                 (uint8_t*)ofb->port->fb);
-			break;
-		}
+	/* Nothing can be seen through this clip */
+	if (ofb->port->plane_hidden)
+		return Success;
 
-		/* Planar formats (as the name says) have the YUV colorspace
-		 * components separated to individual planes. The Y plane is
-		 * full resolution, while the U and V planes are 1/4th (both
-		 * dimensions divided by 2) so a macropixel translates to
-		 * 2x2 pixels on screen
-		 */
-		case FOURCC_I420:
-			/* I420 has plane order Y, U, V */
-		{
-			int src_y_pitch = (src_w + 3) & ~3;
-			int src_uv_pitch = (((src_y_pitch >> 1) + 3) & ~3);
-			uint8_t *yb = buf;
-			uint8_t *ub = yb + (src_y_pitch * src_h);
-			uint8_t *vb = ub + (src_uv_pitch * (src_h / 2));
-			uv12_to_uyvy(src_w & ~15,
-			             src_h & ~15,
-			             src_y_pitch,
-			             src_uv_pitch,
-			             yb, ub, vb,
-			             (uint8_t*)ofb->port->fb);
-			break;
-		}
-		case FOURCC_YV12:
-			/* YV12 has plane order Y, V, U */
-		{
-			int src_y_pitch = (src_w + 3) & ~3;
-			int src_uv_pitch = (((src_y_pitch >> 1) + 3) & ~3);
-			uint8_t *yb = buf;
-			uint8_t *vb = yb + (src_y_pitch * src_h);
-			uint8_t *ub = vb + (src_uv_pitch * (src_h / 2));
-			uv12_to_uyvy(src_w & ~15,
-			             src_h & ~15,
-			             src_y_pitch,
-			             src_uv_pitch,
-			             yb, ub, vb,
-			             (uint8_t*)ofb->port->fb);
-			break;
-		}
-		default:
-			break;
-	}
+	/* Windows may have moved on top of the video without it moving */
+	OMAPXVUpdateGfxPlane(pScrn, clipBoxes);
+
+	/* Only the part of the frame that will be seen is converted */
+	OMAPXVGetSource(image, buf, width, height, src_x, src_y, &src);
+	OMAPXVVisibleSource(pScrn, &visible);
+	if (ofb->port->state_info.nonstd == OMAPFB_COLOR_YUV420)
+		OMAPXVConvertPlanar(pScrn, &src, &visible);
+	else if (ofb->port->state_info.nonstd == OMAPFB_COLOR_RGB565)
+		OMAPXVConvertRGB565(pScrn, &src, &visible);
+	else
+		OMAPXVConvertPacked(pScrn, &src, &visible);
 
-	if (sync) {
-		if (ioctl (ofb->port->fd, OMAPFB_SYNC_GFX))
-		{
-			xf86Msg(X_ERROR, "%s: Graphics sync failed\n", __FUNCTION__);
-			return XvBadAlloc;
-		}
-	}
-	
 	return Success;
 }
 
@@ -289,12 +1132,17 @@ int OMAPFBXVStopVideoGeneric (ScrnInfoPtr pScrn, pointer data, Bool cleanup)
 	if (ofb->port == NULL)
 		return Success;
 
-	if(ofb->port->plane_info.enabled) {
-		if (ioctl (ofb->port->fd, OMAPFB_SYNC_GFX))
-		{
-			xf86Msg(X_ERROR, "%s: Graphics sync failed\n", __FUNCTION__);
-			return 0;
-		}
+	/* The key is painted again by the next clipped frame */
+	if (ofb->port->colorkey_active)
+		OMAPXVSetColorKey(pScrn, FALSE);
+	REGION_EMPTY(pScrn->pScreen, &ofb->port->current_clip);
+
+	if (ofb->port->plane_info.enabled || ofb->port->plane_hidden) {
+		if (OMAPXVWaitForUpdate(pScrn, NULL) != Success)
+			return XvBadAlloc;
+
+		/* Bring the graphics back before the video goes away */
+		OMAPXVUpdateGfxPlane(pScrn, NULL);
 
 		if (ioctl (ofb->port->fd, OMAPFB_QUERY_PLANE, &ofb->port->plane_info)) {
 	    		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
@@ -302,7 +1150,9 @@ int OMAPFBXVStopVideoGeneric (ScrnInfoPtr pScrn, pointer data, Bool cleanup)
 		}
 
 		/* Disable the video plane */
-		munmap(ofb->port->fb, ofb->port->mem_info.size);
+		munmap(ofb->port->fb, ofb->port->fb_size);
+		ofb->port->fb = NULL;
+		ofb->port->plane_hidden = FALSE;
 		ofb->port->plane_info.enabled = 0;
 		if (ioctl (ofb->port->fd, OMAPFB_SETUP_PLANE, &ofb->port->plane_info)) {
 	    		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
@@ -312,12 +1162,6 @@ int OMAPFBXVStopVideoGeneric (ScrnInfoPtr pScrn, pointer data, Bool cleanup)
     			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
     			           "Failed to query video plane info\n");
 		}
-
-		if (ioctl (ofb->port->fd, OMAPFB_SYNC_GFX))
-		{
-			xf86Msg(X_ERROR, "%s: Graphics sync failed\n", __FUNCTION__);
-			return 0;
-		}
 	}
 
 	if (cleanup == TRUE) {
@@ -0,0 +1,279 @@
+/* Texas Instruments OMAP framebuffer driver for X.Org
+ * Copyright 2008 Kalle Vahlman, <zuh@iki.fi>
+ *
+ * Permission to use, copy, modify, distribute and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the names of the authors and/or copyright holders
+ * not be used in advertising or publicity pertaining to distribution of the
+ * software without specific, written prior permission.  The authors and
+ * copyright holders make no representations about the suitability of this
+ * software for any purpose.  It is provided "as is" without any express
+ * or implied warranty.
+ *
+ * THE AUTHORS AND COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * PutImage implementation for the Epson HWA742 LCD controller, found on
+ * eg. Nokia 770
+ *
+ * Known features/limitations:
+ *  - no scaling, but the controller can double the pixels of an update
+ *    window
+ *  - no overlays, the video window simply replaces the graphics in the
+ *    controller memory
+ *  - update windows only carry RGB565 or YUV420 data. The YUV420 is a
+ *    controller specific 12bpp layout rather than standard planes, so
+ *    video is converted to RGB565 and sent as that
+ *  - update window position and height must be divisible by 2, the width
+ *    by 8 for YUV420
+ */
+
+#include "xf86.h"
+#include "xf86_OSlib.h"
+#include "xf86xv.h"
+#include "fourcc.h"
+
+#include <X11/extensions/Xv.h>
+#include <stdint.h>
+
+#include "omapfb-driver.h"
+#include "omapfb-xv-platform.h"
+
+/* HWA742 is found on eg. Nokia 770 */
+int OMAPFBXVPutImageHWA742 (ScrnInfoPtr pScrn,
+                            short src_x, short src_y, short drw_x, short drw_y,
+                            short src_w, short src_h, short drw_w, short drw_h,
+                            int image, char *buf, short width, short height,
+                            Bool sync, RegionPtr clipBoxes, pointer data)
+{
+	struct omapfb_update_window w;
+	OMAPFBPtr ofb = OMAPFB(pScrn);
+	const OMAPFBXVBackendRec *b = ofb->port->backend;
+	OMAPXVSourceRec src;
+	BoxRec visible;
+	int do_clip = !REGION_EQUAL(pScrn, &ofb->port->current_clip, clipBoxes);
+
+	if ((!ofb->port->plane_info.enabled && !ofb->port->plane_hidden)
+	 || ofb->port->update_window.x != src_x
+	 || ofb->port->update_window.y != src_y
+	 || ofb->port->update_window.width != src_w
+	 || ofb->port->update_window.height != src_h
+	 || ofb->port->update_window.format != OMAPXVPlaneFormat(pScrn, image)
+	 || ofb->port->update_window.out_x != drw_x
+	 || ofb->port->update_window.out_y != drw_y
+	 || ofb->port->update_window.out_width != drw_w
+	 || ofb->port->update_window.out_height != drw_h
+	 || do_clip)
+	{
+		int ret;
+		int scale, out_w, out_h, pos_x, pos_y;
+
+		/* Currently this is only used to track the plane state */
+		ofb->port->update_window.x = src_x;
+		ofb->port->update_window.y = src_y;
+		ofb->port->update_window.width = src_w;
+		ofb->port->update_window.height = src_h;
+		ofb->port->update_window.format = OMAPXVPlaneFormat(pScrn, image);
+		ofb->port->update_window.out_x = drw_x;
+		ofb->port->update_window.out_y = drw_y;
+		ofb->port->update_window.out_width = drw_w;
+		ofb->port->update_window.out_height = drw_h;
+
+		/* If we don't have the plane memory, allocate it */
+		if (!ofb->port->plane_info.enabled
+		 && !ofb->port->plane_hidden) {
+			ret = OMAPXVAllocPlane(pScrn);
+			if (ret != Success)
+				return ret;
+		}
+
+		/* The controller can't scale, so the video is shown at its
+		 * own size (or doubled), centered on the requested area
+		 */
+		ofb->port->pixel_doubled = OMAPXVUsePixelDouble(pScrn,
+		                                                src_w, src_h,
+		                                                drw_w, drw_h);
+		scale = ofb->port->pixel_doubled ? 2 : 1;
+
+		out_w = src_w;
+		out_h = src_h;
+		if (out_w > ofb->state_info.xres / scale)
+			out_w = ofb->state_info.xres / scale;
+		if (out_h > ofb->state_info.yres / scale)
+			out_h = ofb->state_info.yres / scale;
+		out_w = OMAPXV_ALIGN(out_w, b->width_align);
+		out_h = OMAPXV_ALIGN(out_h, b->height_align);
+
+		ofb->port->state_info.xres = out_w;
+		ofb->port->state_info.yres = out_h;
+		ofb->port->state_info.xres_virtual = out_w;
+		ofb->port->state_info.yres_virtual = out_h;
+		ofb->port->state_info.xoffset = 0;
+		ofb->port->state_info.yoffset = 0;
+		ofb->port->state_info.rotate = 0;
+		ofb->port->state_info.grayscale = 0;
+		ofb->port->state_info.activate = FB_ACTIVATE_NOW;
+		ofb->port->state_info.bits_per_pixel = 0;
+		ofb->port->state_info.nonstd = OMAPXVPlaneFormat(pScrn, image);
+
+		out_w *= scale;
+		out_h *= scale;
+		pos_x = drw_x + (drw_w - out_w) / 2;
+		pos_y = drw_y + (drw_h - out_h) / 2;
+
+		ofb->port->plane_info.enabled = 1;
+		ofb->port->plane_info.pos_x = OMAPXV_ALIGN(pos_x, b->pos_align);
+		ofb->port->plane_info.pos_y = OMAPXV_ALIGN(pos_y, b->pos_align);
+		ofb->port->plane_info.out_width = out_w;
+		ofb->port->plane_info.out_height = out_h;
+
+		/* The geometry was set up from scratch, clip it again */
+		ret = OMAPFBXVApplyClip(pScrn, clipBoxes);
+		if (ret != Success) {
+			xf86Msg(X_NOT_IMPLEMENTED,
+			        "Complex clipping of video not supported"
+			        " without a color key\n");
+			/* Hide the video until the clip changes, but return
+			 * Success so that clients don't die in case this was
+			 * just a temprorary thing.
+			 */
+			OMAPXVHidePlane(pScrn, clipBoxes);
+			return Success;
+		}
+		ofb->port->plane_hidden = FALSE;
+
+		ret = OMAPXVSetupVideoPlane(pScrn);
+		if (ret != Success)
+			return ret;
+
+		ret = b->update_mode;
+		if (ioctl (ofb->port->fd, OMAPFB_SET_UPDATE_MODE, &ret))
+		{
+			xf86Msg(X_ERROR, "%s: Failed to set manual update mode:"
+			                 " %s\n", __FUNCTION__, strerror(errno));
+			return XvBadAlloc;
+		}
+	}
+
+	/* Nothing can be seen through this clip */
+	if (ofb->port->plane_hidden)
+		return Success;
+
+	/* Only the part of the frame that will be seen is converted, but
+	 * not while the controller is still reading it
+	 */
+	OMAPXVGetSource(image, buf, width, height, src_x, src_y, &src);
+	OMAPXVVisibleSource(pScrn, &visible);
+	if (OMAPXVWaitForUpdate(pScrn, &visible) != Success)
+		return XvBadAlloc;
+	OMAPXVConvertRGB565(pScrn, &src, &visible);
+
+	/* Send only the video window, the controller doubles it on the
+	 * way out if needed
+	 */
+	w.x = ofb->port->state_info.xoffset;
+	w.y = ofb->port->state_info.yoffset;
+	w.width = ofb->port->state_info.xres;
+	w.height = ofb->port->state_info.yres;
+	w.format = ofb->port->state_info.nonstd;
+	if (ofb->port->pixel_doubled)
+		w.format |= OMAPFB_FORMAT_FLAG_DOUBLE;
+	if (b->tearsync && (ofb->port->caps.ctrl & OMAPFB_CAPS_TEARSYNC))
+		w.format |= OMAPFB_FORMAT_FLAG_TEARSYNC;
+	w.out_x = ofb->port->plane_info.pos_x;
+	w.out_y = ofb->port->plane_info.pos_y;
+	w.out_width = ofb->port->plane_info.out_width;
+	w.out_height = ofb->port->plane_info.out_height;
+
+	if (ioctl (ofb->port->fd, OMAPFB_UPDATE_WINDOW, &w))
+	{
+		xf86Msg(X_ERROR, "%s: Failed to update video window:"
+		                 " %s\n", __FUNCTION__, strerror(errno));
+		return XvBadAlloc;
+	}
+	OMAPXVMarkUpdate(pScrn, w.x, w.y, w.width, w.height);
+
+	/* The graphics around the video still need manual updates */
+	if (OMAPXVUpdateGfxAroundVideo(pScrn) != Success)
+		return XvBadAlloc;
+
+	return Success;
+}
+
+/* Stop video, only deinit overlay if cleanup is true */
+int OMAPFBXVStopVideoHWA742 (ScrnInfoPtr pScrn, pointer data, Bool cleanup)
+{
+	OMAPFBPtr ofb = OMAPFB(pScrn);
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO, "XV: %s (%i)\n", __FUNCTION__, cleanup);
+
+	if (ofb->port == NULL)
+		return Success;
+
+	/* The key is painted again by the next clipped frame */
+	if (ofb->port->colorkey_active)
+		OMAPXVSetColorKey(pScrn, FALSE);
+	REGION_EMPTY(pScrn->pScreen, &ofb->port->current_clip);
+
+	if (ofb->port->plane_info.enabled || ofb->port->plane_hidden) {
+		int mode;
+
+		/* Disable the video plane first, there's no overlay to
+		 * hide it so the graphics must be sent over it
+		 */
+		munmap(ofb->port->fb, ofb->port->fb_size);
+		ofb->port->fb = NULL;
+		ofb->port->plane_hidden = FALSE;
+		ofb->port->plane_info.enabled = 0;
+		if (ioctl (ofb->port->fd, OMAPFB_SETUP_PLANE, &ofb->port->plane_info)) {
+			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+			           "Failed to disable video plane\n");
+		}
+
+		if (OMAPXVUpdateGfxRect(pScrn, 0, 0,
+		                        ofb->state_info.xres,
+		                        ofb->state_info.yres) != Success)
+			return XvBadAlloc;
+
+		mode = OMAPFB_AUTO_UPDATE;
+		if (ioctl (ofb->port->fd, OMAPFB_SET_UPDATE_MODE, &mode))
+		{
+			xf86Msg(X_ERROR, "%s: Failed to set auto update mode:"
+			                 " %s\n", __FUNCTION__, strerror(errno));
+			return XvBadAlloc;
+		}
+
+		if (ioctl (ofb->port->fd, OMAPFB_QUERY_PLANE, &ofb->port->plane_info)) {
+			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+			           "Failed to query video plane info\n");
+		}
+	}
+
+	if (cleanup == TRUE) {
+		/* The memory is about to be freed */
+		if (OMAPXVWaitForUpdate(pScrn, NULL) != Success)
+			return XvBadAlloc;
+
+		if(ioctl(ofb->port->fd, OMAPFB_QUERY_MEM, &ofb->port->mem_info) != 0) {
+			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+			           "Failed to fetch memory info\n");
+			return XvBadAlloc;
+		}
+		ofb->port->mem_info.size = 0;
+		if(ioctl(ofb->port->fd, OMAPFB_SETUP_MEM, &ofb->port->mem_info) != 0) {
+			xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
+			           "Failed to set memory info\n");
+			return XvBadAlloc;
+		}
+	}
+
+	return Success;
+}
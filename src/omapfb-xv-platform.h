@@ -30,11 +30,167 @@
 #ifndef __OMAPFB_XV_PLATFORM_H__
 #define __OMAPFB_XV_PLATFORM_H__
 
+#include <stdint.h>
+
 #include "omapfb-driver.h"
 
+/* Video plane backends describe how a controller handles the video plane,
+ * one is picked at init time from the capabilities reported by omapfb.
+ * The per-frame choices (plane format, pixel doubling) are made by the
+ * backend from its description.
+ */
+typedef struct _OMAPFBXVBackendRec {
+	const char *name;
+
+	/* OMAPFB_CAPS_* bits the backend can't do without */
+	unsigned int required_caps;
+
+	/* Alignment of plane position and source offset, source width and
+	 * height and plane output size, in pixels (power of two). YUV
+	 * source offsets are kept on whole chroma samples on top of this.
+	 */
+	int pos_align;
+	int width_align;
+	int height_align;
+	int out_align;
+
+	/* Whether the plane can be scaled. Without scaling the plane output
+	 * is always the source size, or twice it when pixel doubled.
+	 */
+	Bool scaling;
+
+	/* Update mode used while video is shown */
+	enum omapfb_update_mode update_mode;
+
+	/* Whether updates may be synced to the panel if it supports it */
+	Bool tearsync;
+
+	/* Whether the controller composites the plane with the graphics,
+	 * so video can be keyed in through complex clips
+	 */
+	Bool colorkey;
+
+	/* Plane color formats that can be written without conversion,
+	 * as (1 << OMAPFB_COLOR_*) bits
+	 */
+	unsigned int native_formats;
+
+	int (*PutImage) (ScrnInfoPtr pScrn,
+	                 short src_x, short src_y, short drw_x, short drw_y,
+	                 short src_w, short src_h, short drw_w, short drw_h,
+	                 int image, char *buf, short width, short height,
+	                 Bool sync, RegionPtr clipBoxes, pointer data);
+	int (*StopVideo) (ScrnInfoPtr pScrn, pointer data, Bool cleanup);
+} OMAPFBXVBackendRec, *OMAPFBXVBackendPtr;
+
+#define OMAPXV_ALIGN(v, a) ((v) & ~((a) - 1))
+
+/* Semi-planar 4:2:0 with interleaved chroma, as put out by the DSP/IVA
+ * decoders. Older servers don't know about them.
+ */
+#ifndef FOURCC_NV12
+#define FOURCC_NV12 0x3231564e
+#define XVIMAGE_NV12 \
+   { \
+	FOURCC_NV12, \
+	XvYUV, \
+	LSBFirst, \
+	{'N','V','1','2', \
+	  0x00,0x00,0x00,0x10,0x80,0x00,0x00,0xAA,0x00,0x38,0x9B,0x71}, \
+	12, \
+	XvPlanar, \
+	2, \
+	0, 0, 0, 0, \
+	8, 8, 8, \
+	1, 2, 2, \
+	1, 2, 2, \
+	{'Y','U','V', \
+	  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0}, \
+	XvTopToBottom \
+   }
+#endif
+
+/* RGB565 frames from camera previews, emulators and the like, scanned
+ * out by the plane as they are
+ */
+#define FOURCC_RGB565 0x50424752
+#define XVIMAGE_RGB565 \
+   { \
+	FOURCC_RGB565, \
+	XvRGB, \
+	LSBFirst, \
+	{'R','G','B','P', \
+	  0x00,0x00,0x00,0x10,0x80,0x00,0x00,0xAA,0x00,0x38,0x9B,0x71}, \
+	16, \
+	XvPacked, \
+	1, \
+	16, 0xF800, 0x07E0, 0x001F, \
+	0, 0, 0, \
+	0, 0, 0, \
+	0, 0, 0, \
+	{'R','G','B', \
+	  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0}, \
+	XvTopToBottom \
+   }
+
+#ifndef FOURCC_NV21
+#define FOURCC_NV21 0x3132564e
+#define XVIMAGE_NV21 \
+   { \
+	FOURCC_NV21, \
+	XvYUV, \
+	LSBFirst, \
+	{'N','V','2','1', \
+	  0x00,0x00,0x00,0x10,0x80,0x00,0x00,0xAA,0x00,0x38,0x9B,0x71}, \
+	12, \
+	XvPlanar, \
+	2, \
+	0, 0, 0, 0, \
+	8, 8, 8, \
+	1, 2, 2, \
+	1, 2, 2, \
+	{'Y','V','U', \
+	  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0}, \
+	XvTopToBottom \
+   }
+#endif
+
+/* A client image as passed to PutImage. Plane memory coordinates are
+ * relative to the source origin in it.
+ */
+typedef struct {
+	int id;
+	uint8_t *planes[3];
+	int pitches[3];
+	int x, y;
+} OMAPXVSourceRec, *OMAPXVSourcePtr;
+
+/* RGB565 key color for clipped video, a dark shade unlikely in the UI */
+#define OMAPXV_COLORKEY_DEFAULT 0x0821
+
 enum omapfb_color_format xv_to_omapfb_format(int format);
+enum omapfb_color_format OMAPXVPlaneFormat(ScrnInfoPtr pScrn, int image);
 int OMAPXVAllocPlane(ScrnInfoPtr pScrn);
 int OMAPXVSetupVideoPlane(ScrnInfoPtr pScrn);
+int OMAPXVWaitForUpdate(ScrnInfoPtr pScrn, BoxPtr box);
+void OMAPXVMarkUpdate(ScrnInfoPtr pScrn, int x, int y, int width, int height);
+Bool OMAPXVUsePixelDouble(ScrnInfoPtr pScrn,
+                          short src_w, short src_h,
+                          short drw_w, short drw_h);
+int OMAPXVUpdateGfxRect(ScrnInfoPtr pScrn, int x, int y, int width, int height);
+int OMAPXVUpdateGfxAroundVideo(ScrnInfoPtr pScrn);
+int OMAPXVUpdateGfxPlane(ScrnInfoPtr pScrn, RegionPtr clipBoxes);
+void OMAPXVHidePlane(ScrnInfoPtr pScrn, RegionPtr clipBoxes);
+int OMAPXVSetColorKey(ScrnInfoPtr pScrn, Bool enable);
+int OMAPFBXVApplyClip(ScrnInfoPtr pScrn, RegionPtr clipBoxes);
+int OMAPXVImageLayout(int id, int width, int height,
+                      int *pitches, int *offsets);
+void OMAPXVGetSource(int image, char *buf, short width, short height,
+                     short src_x, short src_y, OMAPXVSourcePtr src);
+void OMAPXVVisibleSource(ScrnInfoPtr pScrn, BoxPtr box);
+void OMAPXVConvertPacked(ScrnInfoPtr pScrn, OMAPXVSourcePtr src, BoxPtr box);
+void OMAPXVConvertPlanar(ScrnInfoPtr pScrn, OMAPXVSourcePtr src, BoxPtr box);
+void OMAPXVConvertRGB565(ScrnInfoPtr pScrn, OMAPXVSourcePtr src, BoxPtr box);
 
 int OMAPFBXVPutImageGeneric (ScrnInfoPtr pScrn,
                              short src_x, short src_y, short drw_x, short drw_y,
@@ -51,7 +207,26 @@ int OMAPFBXVPutImageBlizzard (ScrnInfoPtr pScrn,
                              Bool sync, RegionPtr clipBoxes, pointer data);
 int OMAPFBXVStopVideoBlizzard (ScrnInfoPtr pScrn, pointer data, Bool cleanup);
 
-#define OUTPUT_IS_OFFSCREEN (drw_x < 0 || drw_y < 0 || drw_x + drw_w > ofb->state_info.xres || drw_y + drw_h > ofb->state_info.yres)
+/* HWA742 is found on eg. Nokia 770 */
+int OMAPFBXVPutImageHWA742 (ScrnInfoPtr pScrn,
+                            short src_x, short src_y, short drw_x, short drw_y,
+                            short src_w, short src_h, short drw_w, short drw_h,
+                            int image, char *buf, short width, short height,
+                            Bool sync, RegionPtr clipBoxes, pointer data);
+int OMAPFBXVStopVideoHWA742 (ScrnInfoPtr pScrn, pointer data, Bool cleanup);
+
+int OMAPFBXVQueryBestSize (ScrnInfoPtr pScrn,
+                           Bool motion, short vid_w, short vid_h,
+                           short drw_w, short drw_h,
+                           unsigned int *p_w, unsigned int *p_h, pointer data);
+
+/* Software adaptor drawing into the graphics plane */
+XF86VideoAdaptorPtr OMAPFBXVSWInit(ScrnInfoPtr pScrn);
+
+/* Values for the XV_PIXEL_DOUBLE attribute */
+#define OMAPFB_PIXEL_DOUBLE_OFF  0
+#define OMAPFB_PIXEL_DOUBLE_ON   1
+#define OMAPFB_PIXEL_DOUBLE_AUTO 2
 
 #endif /* __OMAPFB_XV_PLATFORM_H__ */
 
@@ -0,0 +1,355 @@
+/* Texas Instruments OMAP framebuffer driver for X.Org
+ * Copyright 2008 Kalle Vahlman, <zuh@iki.fi>
+ *
+ * Permission to use, copy, modify, distribute and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the names of the authors and/or copyright holders
+ * not be used in advertising or publicity pertaining to distribution of the
+ * software without specific, written prior permission.  The authors and
+ * copyright holders make no representations about the suitability of this
+ * software for any purpose.  It is provided "as is" without any express
+ * or implied warranty.
+ *
+ * THE AUTHORS AND COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Software XV adaptor, drawing the video into the window
+ *
+ * The frames are scaled and converted to RGB a band of lines at a time,
+ * only for the part the clip region can show, and put into the drawable
+ * like any other image. Clipping, redirected windows and damage are then
+ * handled by X. It works without the video plane and with any clipping,
+ * at the cost of doing all of it on the CPU.
+ */
+
+#include "xf86.h"
+#include "xf86_OSlib.h"
+#include "xf86xv.h"
+#include "fourcc.h"
+#include "gcstruct.h"
+#include "servermd.h"
+
+#include <X11/extensions/Xv.h>
+#include <stdint.h>
+
+#include "omapfb-driver.h"
+#include "omapfb-xv-platform.h"
+#include "image-format-conversions.h"
+
+/* Largest source image accepted */
+#define OMAPFB_SW_MAX_WIDTH  2048
+#define OMAPFB_SW_MAX_HEIGHT 2048
+
+/* Lines converted before they are put into the drawable */
+#define OMAPFB_SW_BAND 16
+
+#define OMAPFB_SW_FILTER_NEAREST  0
+#define OMAPFB_SW_FILTER_BILINEAR 1
+
+typedef struct {
+	int filter;
+	/* One scaled line of Y, U and V samples, as wide as the screen */
+	uint8_t *lines;
+	/* A band of converted lines, as wide as the screen */
+	uint8_t *band;
+} OMAPFBSWPortRec, *OMAPFBSWPortPtr;
+
+/* Where the samples of a source image are, for one component */
+typedef struct {
+	uint8_t *base;
+	int pitch;
+	/* Bytes between horizontally adjacent samples */
+	int step;
+	/* Number of samples in a line */
+	int len;
+	/* Vertical subsampling */
+	int vsub;
+} OMAPFBSWComponentRec;
+
+static XF86VideoEncodingRec sw_encodings[] = {
+    { 0, "XV_IMAGE", OMAPFB_SW_MAX_WIDTH, OMAPFB_SW_MAX_HEIGHT, { 1, 1 } },
+};
+
+static XF86VideoFormatRec sw_formats[] = {
+    { 16, TrueColor },
+    { 24, TrueColor },
+};
+
+/* Planar images first, they have the least data to read */
+static XF86ImageRec sw_images[] = {
+    XVIMAGE_YV12,
+    XVIMAGE_I420,
+    XVIMAGE_NV12,
+    XVIMAGE_NV21,
+    XVIMAGE_UYVY,
+    XVIMAGE_YUY2,
+};
+
+static XF86AttributeRec sw_attributes[] = {
+    { XvSettable | XvGettable, OMAPFB_SW_FILTER_NEAREST,
+                               OMAPFB_SW_FILTER_BILINEAR, "XV_FILTER" },
+};
+
+static Atom xv_filter;
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+static int OMAPFBSWSetPortAttribute (ScrnInfoPtr pScrn, Atom attribute,
+                                     INT32 value, pointer data)
+{
+	OMAPFBSWPortPtr port = (OMAPFBSWPortPtr)data;
+
+	if (attribute != xv_filter)
+		return BadMatch;
+	if (value < OMAPFB_SW_FILTER_NEAREST
+	 || value > OMAPFB_SW_FILTER_BILINEAR)
+		return BadValue;
+	port->filter = value;
+
+	return Success;
+}
+
+static int OMAPFBSWGetPortAttribute (ScrnInfoPtr pScrn, Atom attribute,
+                                     INT32 *value, pointer data)
+{
+	OMAPFBSWPortPtr port = (OMAPFBSWPortPtr)data;
+
+	if (attribute != xv_filter)
+		return BadMatch;
+	*value = port->filter;
+
+	return Success;
+}
+
+static int OMAPFBSWQueryImageAttributes (ScrnInfoPtr pScrn,
+                                         int id, short *width, short *height,
+                                         int *pitches, int *offsets)
+{
+	if (*width > OMAPFB_SW_MAX_WIDTH)
+		*width = OMAPFB_SW_MAX_WIDTH;
+	if (*height > OMAPFB_SW_MAX_HEIGHT)
+		*height = OMAPFB_SW_MAX_HEIGHT;
+
+	return OMAPXVImageLayout(id, *width, *height, pitches, offsets);
+}
+
+/* Describe the Y, U and V samples of the source */
+static void OMAPFBSWGetComponents(OMAPXVSourcePtr src, short src_w,
+                                  OMAPFBSWComponentRec *c)
+{
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		c[i].base = src->planes[i];
+		c[i].pitch = src->pitches[i];
+		c[i].step = 1;
+		c[i].len = i ? src_w / 2 : src_w;
+		c[i].vsub = i ? 2 : 1;
+	}
+
+	switch (src->id)
+	{
+		case FOURCC_NV12:
+		case FOURCC_NV21:
+			/* Chroma pairs interleaved in one plane */
+			c[1].base = src->planes[1]
+			            + (src->id == FOURCC_NV12 ? 0 : 1);
+			c[2].base = src->planes[1]
+			            + (src->id == FOURCC_NV12 ? 1 : 0);
+			c[2].pitch = c[1].pitch;
+			c[1].step = c[2].step = 2;
+			break;
+		case FOURCC_UYVY:
+		case FOURCC_YUY2:
+			/* Everything in 4-byte macropixels, full height */
+			for (i = 0; i < 3; i++) {
+				c[i].pitch = src->pitches[0];
+				c[i].step = i ? 4 : 2;
+				c[i].vsub = 1;
+			}
+			if (src->id == FOURCC_UYVY) {
+				c[0].base = src->planes[0] + 1;
+				c[1].base = src->planes[0];
+				c[2].base = src->planes[0] + 2;
+			} else {
+				c[0].base = src->planes[0];
+				c[1].base = src->planes[0] + 1;
+				c[2].base = src->planes[0] + 3;
+			}
+			break;
+		default:
+			break;
+	}
+
+	/* Start at the source origin */
+	for (i = 0; i < 3; i++)
+		c[i].base += (src->y / c[i].vsub) * c[i].pitch
+		             + (i ? src->x / 2 : src->x) * c[i].step;
+}
+
+/* Scale one line of a component, sy is the 16.16 source row */
+static void OMAPFBSWScaleLine(OMAPFBSWPortPtr port, OMAPFBSWComponentRec *c,
+                              int w, int x, int dx, int sy, int rows,
+                              uint8_t *dest)
+{
+	int row = sy >> 16;
+	uint8_t *line = c->base + row * c->pitch;
+
+	if (port->filter == OMAPFB_SW_FILTER_BILINEAR) {
+		uint8_t *next = line;
+
+		if (row + 1 < rows)
+			next += c->pitch;
+		scale_line_bilinear(w, c->step, c->len, x, dx,
+		                    (sy >> 8) & 0xff, line, next, dest);
+	} else {
+		scale_line_nearest(w, c->step, x, dx, line, dest);
+	}
+}
+
+static int OMAPFBSWPutImage (ScrnInfoPtr pScrn,
+                             short src_x, short src_y, short drw_x, short drw_y,
+                             short src_w, short src_h, short drw_w, short drw_h,
+                             int image, char *buf, short width, short height,
+                             Bool sync, RegionPtr clipBoxes, pointer data,
+                             DrawablePtr pDraw)
+{
+	OMAPFBPtr ofb = OMAPFB(pScrn);
+	OMAPFBSWPortPtr port = (OMAPFBSWPortPtr)data;
+	OMAPFBSWComponentRec c[3];
+	OMAPXVSourceRec src;
+	BoxRec box;
+	GCPtr pGC;
+	int bpp = pScrn->bitsPerPixel / 8;
+	int pitch, w, x, y, dx, dy;
+
+	if (ofb->blanked || drw_w <= 0 || drw_h <= 0)
+		return Success;
+
+	/* The lines are converted to the screen format */
+	if (pDraw->bitsPerPixel != pScrn->bitsPerPixel)
+		return BadMatch;
+
+	/* Only the part of the video the clip can show is converted, the
+	 * drawing itself is clipped to the window by the GC
+	 */
+	box = *REGION_EXTENTS(pScrn->pScreen, clipBoxes);
+	box.x1 = max(box.x1, drw_x);
+	box.y1 = max(box.y1, drw_y);
+	box.x2 = min(box.x2, drw_x + drw_w);
+	box.y2 = min(box.y2, drw_y + drw_h);
+	w = box.x2 - box.x1;
+	if (w <= 0 || box.y1 >= box.y2)
+		return Success;
+
+	pGC = GetScratchGC(pDraw->depth, pScrn->pScreen);
+	if (pGC == NULL)
+		return BadAlloc;
+	ValidateGC(pDraw, pGC);
+
+	OMAPXVGetSource(image, buf, width, height, src_x, src_y, &src);
+	OMAPFBSWGetComponents(&src, src_w, c);
+
+	/* 16.16 fixed point source steps */
+	dx = (src_w << 16) / drw_w;
+	dy = (src_h << 16) / drw_h;
+	x = (box.x1 - drw_x) * dx;
+	pitch = PixmapBytePad(w, pDraw->depth);
+
+	for (y = box.y1; y < box.y2; y += OMAPFB_SW_BAND) {
+		int rows = min(OMAPFB_SW_BAND, box.y2 - y);
+		int i;
+
+		for (i = 0; i < rows; i++) {
+			int sy = (y + i - drw_y) * dy;
+			uint8_t *yl = port->lines;
+			uint8_t *ul = yl + w;
+			uint8_t *vl = ul + w;
+			uint8_t *dest = port->band + i * pitch;
+
+			OMAPFBSWScaleLine(port, &c[0], w, x, dx, sy,
+			                  src_h, yl);
+			OMAPFBSWScaleLine(port, &c[1], w, x / 2, dx / 2,
+			                  sy / c[1].vsub, src_h / c[1].vsub, ul);
+			OMAPFBSWScaleLine(port, &c[2], w, x / 2, dx / 2,
+			                  sy / c[2].vsub, src_h / c[2].vsub, vl);
+
+			if (bpp == 2)
+				yuv444_to_rgb565(w, yl, ul, vl, (uint16_t*)dest);
+			else
+				yuv444_to_xrgb8888(w, yl, ul, vl, (uint32_t*)dest);
+		}
+
+		/* Drawable coordinates, the window may be redirected */
+		(*pGC->ops->PutImage)(pDraw, pGC, pDraw->depth,
+		                      box.x1 - pDraw->x, y - pDraw->y,
+		                      w, rows, 0, ZPixmap, (char*)port->band);
+	}
+
+	FreeScratchGC(pGC);
+
+	return Success;
+}
+
+/* The frames went into the window like any other drawing, so it simply
+ * keeps the last one
+ */
+static int OMAPFBSWStopVideo (ScrnInfoPtr pScrn, pointer data, Bool cleanup)
+{
+	return Success;
+}
+
+XF86VideoAdaptorPtr OMAPFBXVSWInit(ScrnInfoPtr pScrn)
+{
+	XF86VideoAdaptorPtr adaptor;
+	OMAPFBSWPortPtr port;
+	OMAPFBPtr ofb = OMAPFB(pScrn);
+
+	/* The graphics plane needs to be RGB565 or XRGB8888 */
+	if (pScrn->bitsPerPixel != 16 && pScrn->bitsPerPixel != 32)
+		return NULL;
+
+	adaptor = xf86XVAllocateVideoAdaptorRec(pScrn);
+	if (adaptor == NULL)
+		return NULL;
+
+	port = xnfcalloc(sizeof(OMAPFBSWPortRec), 1);
+	port->filter = OMAPFB_SW_FILTER_NEAREST;
+	port->lines = xnfalloc(ofb->state_info.xres * 3);
+	port->band = xnfalloc(PixmapBytePad(ofb->state_info.xres, pScrn->depth)
+	                      * OMAPFB_SW_BAND);
+
+	adaptor->type = XvInputMask | XvImageMask | XvWindowMask;
+	adaptor->flags = VIDEO_CLIP_TO_VIEWPORT;
+	adaptor->name = xstrdup("OMAP XV software adaptor");
+	adaptor->nEncodings = ARRAY_SIZE(sw_encodings);
+	adaptor->pEncodings = sw_encodings;
+	adaptor->nFormats = ARRAY_SIZE(sw_formats);
+	adaptor->pFormats = sw_formats;
+	adaptor->nPorts = 1;
+	adaptor->pPortPrivates = xnfcalloc(sizeof(DevUnion), 1);
+	adaptor->pPortPrivates[0].ptr = port;
+	adaptor->nAttributes = ARRAY_SIZE(sw_attributes);
+	adaptor->pAttributes = sw_attributes;
+	adaptor->nImages = ARRAY_SIZE(sw_images);
+	adaptor->pImages = sw_images;
+	adaptor->SetPortAttribute = OMAPFBSWSetPortAttribute;
+	adaptor->GetPortAttribute = OMAPFBSWGetPortAttribute;
+	adaptor->QueryBestSize = OMAPFBXVQueryBestSize;
+	adaptor->QueryImageAttributes = OMAPFBSWQueryImageAttributes;
+	adaptor->PutImage = OMAPFBSWPutImage;
+	adaptor->StopVideo = OMAPFBSWStopVideo;
+
+	xv_filter = MakeAtom("XV_FILTER", sizeof("XV_FILTER") - 1, TRUE);
+
+	return adaptor;
+}
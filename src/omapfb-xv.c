@@ -54,17 +54,65 @@ static XF86VideoFormatRec xv_formats[OMAPFB_XV_FORMAT_COUNT] = {
     { 24, TrueColor },
 };
 
-static XF86ImageRec xv_images[] = {
+static XF86ImageRec xv_all_images[] = {
     XVIMAGE_YUY2, /* OMAPFB_COLOR_YUY422 */
     XVIMAGE_UYVY, /* OMAPFB_COLOR_YUV422 */
     XVIMAGE_I420, /* OMAPFB_COLOR_YUV420 */
     XVIMAGE_YV12, /* OMAPFB_COLOR_YUV420 */
+    XVIMAGE_NV12, /* OMAPFB_COLOR_YUV420 */
+    XVIMAGE_NV21, /* OMAPFB_COLOR_YUV420 */
+    XVIMAGE_RGB565, /* OMAPFB_COLOR_RGB565 */
 };
+#define OMAPFB_XV_IMAGE_COUNT \
+	(sizeof(xv_all_images) / sizeof(xv_all_images[0]))
+
+/* The images advertised for the video plane, cheapest first */
+static XF86ImageRec xv_images[OMAPFB_XV_IMAGE_COUNT];
 
 /* TODO: */
 static XF86AttributeRec xv_attributes[] = {
     { XvSettable | XvGettable, 0, 0xffff, "XV_COLORKEY" },
+    { XvSettable | XvGettable, OMAPFB_PIXEL_DOUBLE_OFF,
+                               OMAPFB_PIXEL_DOUBLE_AUTO, "XV_PIXEL_DOUBLE" },
+};
+#define OMAPFB_XV_ATTRIBUTE_COUNT \
+	(sizeof(xv_attributes) / sizeof(xv_attributes[0]))
+
+/* Video plane backends, in order of preference. The first one whose
+ * required capabilities are all reported for the video plane is used.
+ */
+static const OMAPFBXVBackendRec xv_backends[] = {
+    /* Manual update controllers with a scaling and compositing video
+     * window, eg. Blizzard (Epson S1D13745A01) on Nokia N8x0
+     */
+    { "blizzard", OMAPFB_CAPS_MANUAL_UPDATE | OMAPFB_CAPS_WINDOW_SCALE,
+      2, 4, 4, 2, TRUE, OMAPFB_MANUAL_UPDATE, TRUE, TRUE,
+      (1 << OMAPFB_COLOR_YUV422) | (1 << OMAPFB_COLOR_YUY422)
+      | (1 << OMAPFB_COLOR_RGB565),
+      OMAPFBXVPutImageBlizzard, OMAPFBXVStopVideoBlizzard },
+    /* Manual update controllers without scaling, eg. HWA742 on Nokia 770.
+     * Their YUV420 is a controller specific layout, video is sent as RGB.
+     */
+    { "hwa742", OMAPFB_CAPS_MANUAL_UPDATE | OMAPFB_CAPS_WINDOW_PIXEL_DOUBLE,
+      2, 8, 2, 2, FALSE, OMAPFB_MANUAL_UPDATE, TRUE, FALSE,
+      (1 << OMAPFB_COLOR_RGB565),
+      OMAPFBXVPutImageHWA742, OMAPFBXVStopVideoHWA742 },
+    /* The internal LCD controller (dispc) scanning out continuously,
+     * planar YUV420 only where the plane reports it
+     */
+    { "internal", 0,
+      1, 16, 16, 16, TRUE, OMAPFB_AUTO_UPDATE, FALSE, TRUE,
+      (1 << OMAPFB_COLOR_YUV422) | (1 << OMAPFB_COLOR_YUY422)
+      | (1 << OMAPFB_COLOR_YUV420) | (1 << OMAPFB_COLOR_RGB565),
+      OMAPFBXVPutImageGeneric, OMAPFBXVStopVideoGeneric },
 };
+#define OMAPFB_XV_BACKEND_COUNT \
+	(sizeof(xv_backends) / sizeof(xv_backends[0]))
+
+#define MAKE_ATOM(a) MakeAtom(a, sizeof(a) - 1, TRUE)
+
+static Atom xv_colorkey;
+static Atom xv_pixel_double;
 
 /* Port */
 
@@ -80,7 +128,31 @@ int OMAPFBXVSetPortAttribute (ScrnInfoPtr pScrn,
                               INT32 value,
                               pointer data)
 {
+	OMAPFBPtr ofb = OMAPFB(pScrn);
 	xf86DrvMsg(pScrn->scrnIndex, X_INFO, "XV: %s\n", __FUNCTION__);
+
+	if (attribute == xv_pixel_double) {
+		if (value < OMAPFB_PIXEL_DOUBLE_OFF
+		 || value > OMAPFB_PIXEL_DOUBLE_AUTO)
+			return BadValue;
+		if (ofb->port->pixel_double != value) {
+			ofb->port->pixel_double = value;
+			/* Force the plane setup on the next frame */
+			memset(&ofb->port->update_window, 0,
+			       sizeof(struct omapfb_update_window));
+		}
+	} else if (attribute == xv_colorkey) {
+		if (value < 0 || value > 0xffff)
+			return BadValue;
+		ofb->port->colorkey = value;
+		if (ofb->port->colorkey_active) {
+			/* Reprogram the key, the next frame repaints it */
+			if (OMAPXVSetColorKey(pScrn, TRUE) != Success)
+				return BadValue;
+			REGION_EMPTY(pScrn->pScreen, &ofb->port->current_clip);
+		}
+	}
+
 	return Success;
 }
 
@@ -90,9 +162,17 @@ int OMAPFBXVGetPortAttribute (ScrnInfoPtr pScrn,
                               INT32 *value,
                               pointer data)
 {
+	OMAPFBPtr ofb = OMAPFB(pScrn);
 	xf86DrvMsg(pScrn->scrnIndex, X_INFO, "XV: %s\n", __FUNCTION__);
 
-	if (value != NULL)
+	if (value == NULL)
+		return Success;
+
+	if (attribute == xv_pixel_double)
+		*value = ofb->port->pixel_double;
+	else if (attribute == xv_colorkey)
+		*value = ofb->port->colorkey;
+	else
 		*value = 1;
 	return Success;
 }
@@ -125,65 +205,138 @@ int OMAPFBXVQueryImageAttributes (ScrnInfoPtr pScrn,
                                   int *pitches, int *offsets)
 {
 	int w, h;
-	int size = 0;
-	int tmp = 0;
 	OMAPFBPtr ofb = OMAPFB(pScrn);
 
 	w = *width;
 	h = *height;
 
-	if (offsets)
-		offsets[0] = 0;
+	w = (w + 1) & ~1;
+	ofb->port->mem_info.size = w << 1;
+	ofb->port->mem_info.size *= h;
+
+	return OMAPXVImageLayout(id, *width, *height, pitches, offsets);
+}
+
+/* Hand the frame to the backend, unless nobody can see it */
+static int OMAPFBXVPutImage (ScrnInfoPtr pScrn,
+                             short src_x, short src_y, short drw_x, short drw_y,
+                             short src_w, short src_h, short drw_w, short drw_h,
+                             int image, char *buf, short width, short height,
+                             Bool sync, RegionPtr clipBoxes, pointer data,
+                             DrawablePtr pDraw)
+{
+	OMAPFBPtr ofb = OMAPFB(pScrn);
+
+	if (ofb->blanked)
+		return Success;
+
+	return ofb->port->backend->PutImage(pScrn, src_x, src_y, drw_x, drw_y,
+	                                    src_w, src_h, drw_w, drw_h,
+	                                    image, buf, width, height, sync,
+	                                    clipBoxes, data);
+}
+
+/* Called when the display is blanked or woken up. While blanked, frames
+ * are neither converted nor sent to the controller. The buffer of a
+ * dropped frame is only valid during the request, so on wakeup the
+ * plane is set up again from scratch with the next frame instead.
+ */
+void OMAPFBXVSetBlanked(ScrnInfoPtr pScrn, Bool blanked)
+{
+	OMAPFBPtr ofb = OMAPFB(pScrn);
+
+	if (ofb->blanked == blanked)
+		return;
+
+	ofb->blanked = blanked;
+	if (!blanked && ofb->port)
+		memset(&ofb->port->update_window, 0, sizeof(struct omapfb_update_window));
+}
+
+/* Pick the most capable backend the video plane supports. The plane must
+ * also take one of the formats the backend writes.
+ */
+static const OMAPFBXVBackendRec *OMAPFBXVSelectBackend(struct omapfb_caps *caps)
+{
+	int i;
+
+	for (i = 0; i < OMAPFB_XV_BACKEND_COUNT; i++) {
+		if ((caps->ctrl & xv_backends[i].required_caps)
+		    == xv_backends[i].required_caps
+		 && (caps->plane_color & xv_backends[i].native_formats))
+			return &xv_backends[i];
+	}
+
+	return &xv_backends[OMAPFB_XV_BACKEND_COUNT - 1];
+}
+
+/* Relative cost of getting an image into the plane, clients usually pick
+ * the first format they can produce so the cheapest ones go first. Images
+ * that can't be shown at all cost -1.
+ */
+#define OMAPFB_XV_MAX_COST 4
+
+static int OMAPFBXVImageCost(ScrnInfoPtr pScrn, int id)
+{
+	enum omapfb_color_format plane = OMAPXVPlaneFormat(pScrn, id);
 
 	switch (id)
 	{
 		case FOURCC_I420:
 		case FOURCC_YV12:
-			w = (w + 3) & ~3;
-			h = (h + 1) & ~1;
-			size = w;
-			if (pitches)
-				pitches[0] = size;
-			size *= h;
-			if (offsets)
-				offsets[1] = size;
-			tmp = w >> 1;
-			tmp = (tmp + 3) & ~3;
-			if (pitches)
-				pitches[1] = pitches[2] = tmp;
-			tmp *= h >> 1;
-			size += tmp;
-			if (offsets)
-				offsets[2] = size;
-				size += tmp;
+			/* Planes are only re-pitched, and 4:2:0 is the
+			 * smallest to copy
+			 */
+			if (plane == OMAPFB_COLOR_YUV420)
+				return 0;
+			break;
+		case FOURCC_NV12:
+		case FOURCC_NV21:
+			/* Still 4:2:0, the chroma is only split in two */
+			if (plane == OMAPFB_COLOR_YUV420)
+				return 1;
 			break;
+		case FOURCC_RGB565:
+			/* There's no conversion from RGB to YUV */
+			return plane == OMAPFB_COLOR_RGB565 ? 2 : -1;
 		case FOURCC_UYVY:
 		case FOURCC_YUY2:
+			if (plane == xv_to_omapfb_format(id))
+				return 2;
+			/* Byte pairs are swapped */
+			if (plane == OMAPFB_COLOR_YUV422
+			 || plane == OMAPFB_COLOR_YUY422)
+				return 3;
+			break;
 		default:
-			w = (w + 1) & ~1;
-			size = w << 1;
-			if (pitches)
-				pitches[0] = size;
-			size *= h;
 			break;
 	}
 
-	w = *width;
-	h = *height;
+	/* A real conversion between packed and planar */
+	return OMAPFB_XV_MAX_COST;
+}
 
-	w = (w + 1) & ~1;
-	ofb->port->mem_info.size = w << 1;
-	ofb->port->mem_info.size *= h;
+/* Build the advertised image list, ordered by cost for this plane and
+ * leaving out what it can't show
+ */
+static int OMAPFBXVSetupImages(ScrnInfoPtr pScrn)
+{
+	int cost, i, n = 0;
 
-	return size;
+	for (cost = 0; cost <= OMAPFB_XV_MAX_COST; cost++) {
+		for (i = 0; i < OMAPFB_XV_IMAGE_COUNT; i++) {
+			if (OMAPFBXVImageCost(pScrn, xv_all_images[i].id) == cost)
+				xv_images[n++] = xv_all_images[i];
+		}
+	}
+
+	return n;
 }
 
-/* Initialization */
-int OMAPFBXVInit (ScrnInfoPtr pScrn,
-                  XF86VideoAdaptorPtr **omap_adaptors)
+/* Set up the adaptor showing the video on the video plane */
+static XF86VideoAdaptorPtr OMAPFBXVOverlayInit (ScrnInfoPtr pScrn)
 {
 	XF86VideoAdaptorPtr adaptor = NULL;
-	int n_adaptors = 0;
 	const char *name = "OMAP XV adaptor";
 	OMAPFBPtr ofb = OMAPFB(pScrn);
 	
@@ -195,26 +348,26 @@ int OMAPFBXVInit (ScrnInfoPtr pScrn,
 		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
 		           "Failed to open %s: %s\n", OMAP_FBDEV1_NAME, strerror(errno));
 		OMAPFBPortFreeRec(pScrn);
-		return 0;
+		return NULL;
 	}
 	if(ioctl(ofb->port->fd, OMAPFB_QUERY_PLANE, &ofb->port->plane_info) != 0) {
 		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
 		           "Failed to fetch plane info\n");
 		OMAPFBPortFreeRec(pScrn);
-		return 0;
+		return NULL;
 	}
 	ofb->port->plane_info.enabled = 0;
 	if(ioctl(ofb->port->fd, OMAPFB_SETUP_PLANE, &ofb->port->plane_info) != 0) {
 		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
 		           "Failed to setup plane\n");
 		OMAPFBPortFreeRec(pScrn);
-		return 0;
+		return NULL;
 	}
 	if(ioctl(ofb->port->fd, OMAPFB_QUERY_MEM, &ofb->port->mem_info) != 0) {
 		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
 		           "Failed to fetch memory info\n");
 		OMAPFBPortFreeRec(pScrn);
-		return 0;
+		return NULL;
 	}
 
 	/* Deallocate existing memory */
@@ -229,41 +382,41 @@ int OMAPFBXVInit (ScrnInfoPtr pScrn,
 			           "Failed to unallocate video plane memory: %s\n",
 			           strerror(errno));
 			OMAPFBPortFreeRec(pScrn);
-			return 0;
+			return NULL;
 		}
 	}
 	if(ioctl(ofb->port->fd, OMAPFB_QUERY_PLANE, &ofb->port->plane_info) != 0) {
 		xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
 		           "Failed to fetch plane info\n");
 		OMAPFBPortFreeRec(pScrn);
-		return 0;
+		return NULL;
 	}
 
 	if (ioctl (ofb->port->fd, FBIOGET_FSCREENINFO, &ofb->port->fixed_info))
 	{
 		xf86DrvMsg(pScrn->scrnIndex, X_ERROR, "%s: Reading hardware info failed\n", __FUNCTION__);
 		OMAPFBPortFreeRec(pScrn);
-		return 0;
+		return NULL;
 	}
 
-{
-	struct omapfb_caps caps;
-
-	if (ioctl (ofb->port->fd, OMAPFB_GET_CAPS, &caps))
+	if (ioctl (ofb->port->fd, OMAPFB_GET_CAPS, &ofb->port->caps))
 	{
 		OMAPFBPortFreeRec(pScrn);
-		return 0;
+		return NULL;
 	}
 
-	OMAPFBPrintCapabilities(pScrn, &caps, "Video plane");
+	OMAPFBPrintCapabilities(pScrn, &ofb->port->caps, "Video plane");
 
-}
+	ofb->port->backend = OMAPFBXVSelectBackend(&ofb->port->caps);
+	xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+	           "Using %s video plane backend for %s LCD controller\n",
+	           ofb->port->backend->name, ofb->ctrl_name);
 
 	adaptor = xf86XVAllocateVideoAdaptorRec(pScrn);
 	if (adaptor == NULL)
 	{
 		OMAPFBPortFreeRec(pScrn);
-		return 0;
+		return NULL;
 	}
 
 	xv_encodings[0].width = ofb->state_info.xres;
@@ -279,33 +432,49 @@ int OMAPFBXVInit (ScrnInfoPtr pScrn,
 	adaptor->nPorts = 1;
 	/* Place per-port data here */
 	adaptor->pPortPrivates = (DevUnion *)(&adaptor[1]);
-	adaptor->nAttributes = 1;
+	adaptor->nAttributes = OMAPFB_XV_ATTRIBUTE_COUNT;
 	adaptor->pAttributes = xv_attributes;
-	adaptor->nImages = 4;
+	adaptor->nImages = OMAPFBXVSetupImages(pScrn);
 	adaptor->pImages = xv_images;
 	adaptor->SetPortAttribute = OMAPFBXVSetPortAttribute;
 	adaptor->GetPortAttribute = OMAPFBXVGetPortAttribute;
 	adaptor->QueryBestSize = OMAPFBXVQueryBestSize;
 	adaptor->QueryImageAttributes = OMAPFBXVQueryImageAttributes;
 
-	/* Generic implementation */
-	adaptor->PutImage = OMAPFBXVPutImageGeneric;
-	adaptor->StopVideo = OMAPFBXVStopVideoGeneric;
-
-	/* Allow customized functionality for different CPU revisions
-	 * and LCD controller chips
-	 */
-	if (strncmp(ofb->ctrl_name, "blizzard", 8) == 0) {
-		/* Blizzard is Epson S1D13745A01, found on eg. Nokia N8x0 */
-		adaptor->PutImage = OMAPFBXVPutImageBlizzard;
-		adaptor->StopVideo = OMAPFBXVStopVideoBlizzard;
-	}
-	
-	n_adaptors++;
-	
-	*omap_adaptors = xnfcalloc(sizeof(XF86VideoAdaptorPtr*), n_adaptors);
-	*omap_adaptors[0] = adaptor;
+	/* The backend provides functionality for the LCD controller */
+	adaptor->PutImage = OMAPFBXVPutImage;
+	adaptor->StopVideo = ofb->port->backend->StopVideo;
 	
+	xv_colorkey = MAKE_ATOM("XV_COLORKEY");
+	xv_pixel_double = MAKE_ATOM("XV_PIXEL_DOUBLE");
+
+	return adaptor;
+}
+
+/* Initialization. The video plane is preferred, the software adaptor
+ * drawing into the graphics plane is always offered after it.
+ */
+int OMAPFBXVInit (ScrnInfoPtr pScrn,
+                  XF86VideoAdaptorPtr **omap_adaptors)
+{
+	XF86VideoAdaptorPtr adaptors[2];
+	int i, n_adaptors = 0;
+
+	adaptors[n_adaptors] = OMAPFBXVOverlayInit(pScrn);
+	if (adaptors[n_adaptors] != NULL)
+		n_adaptors++;
+
+	adaptors[n_adaptors] = OMAPFBXVSWInit(pScrn);
+	if (adaptors[n_adaptors] != NULL)
+		n_adaptors++;
+
+	if (n_adaptors == 0)
+		return 0;
+
+	*omap_adaptors = xnfcalloc(sizeof(XF86VideoAdaptorPtr), n_adaptors);
+	for (i = 0; i < n_adaptors; i++)
+		(*omap_adaptors)[i] = adaptors[i];
+
 	return n_adaptors;
 }
 
@@ -319,6 +488,8 @@ OMAPFBPortGetRec(ScrnInfoPtr pScrn)
 	
 	ofb->port = xnfcalloc(sizeof(OMAPFBPortRec), 1);
 	memset(&ofb->port->update_window, 0, sizeof(struct omapfb_update_window));
+	ofb->port->pixel_double = OMAPFB_PIXEL_DOUBLE_AUTO;
+	ofb->port->colorkey = OMAPXV_COLORKEY_DEFAULT;
 	REGION_EMPTY(pScrn, &ofb->port->current_clip);
 
 	return TRUE;
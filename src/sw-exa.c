@@ -22,35 +22,70 @@
  */
 
 
+#include <string.h>
+
 #include <X11/X.h>
 #include "omapfb-driver.h"
 
 #include "exa.h"
 
+#include "exa-kernels.h"
+
 #ifdef LOG_CALLS
 # define FALLBACK do { ErrorF("Fallback from %s\n", __FUNCTION__); return FALSE; } while (0)
 #else
 # define FALLBACK return FALSE
 #endif
 
+#define PIXMAP_OMAPFB(p) OMAPFB(xf86Screens[(p)->drawable.pScreen->myNum])
+
+/* CPU address of a pixmap in framebuffer memory */
+static unsigned char *
+SWPixmapAddress(OMAPFBPtr ofb, PixmapPtr pPixmap)
+{
+	return ofb->exa->memoryBase + exaGetPixmapOffset(pPixmap);
+}
+
 /*** Solid fill */
 
 static Bool
 SWPrepareSolid(PixmapPtr pPixmap, int alu, Pixel planemask, Pixel fg)
 {
-	FALLBACK;
+	OMAPFBPtr ofb = PIXMAP_OMAPFB(pPixmap);
+
+	/* Only plain fills, everything else is left to fb */
+	if (alu != GXcopy || !EXA_PM_IS_SOLID(&pPixmap->drawable, planemask))
+		FALLBACK;
+
+	if (pPixmap->drawable.bitsPerPixel != 16
+	 && pPixmap->drawable.bitsPerPixel != 32)
+		FALLBACK;
+
+	ofb->exa_state.dst = SWPixmapAddress(ofb, pPixmap);
+	ofb->exa_state.dst_pitch = exaGetPixmapPitch(pPixmap);
+	ofb->exa_state.bpp = pPixmap->drawable.bitsPerPixel;
+	ofb->exa_state.fg = fg;
+
+	return TRUE;
 }
 
-static Bool
+static void
 SWSolid(PixmapPtr pPixmap, int x1, int y1, int x2, int y2)
 {
-	FALLBACK;
+	OMAPFBExaStateRec *s = &PIXMAP_OMAPFB(pPixmap)->exa_state;
+
+	if (s->bpp == 16) {
+		solid_fill_16(x2 - x1, y2 - y1, s->dst_pitch, s->fg,
+		              s->dst + y1 * s->dst_pitch + x1 * 2);
+	} else {
+		solid_fill_32(x2 - x1, y2 - y1, s->dst_pitch, s->fg,
+		              s->dst + y1 * s->dst_pitch + x1 * 4);
+	}
 }
 
-static Bool
+static void
 SWDoneSolid(PixmapPtr pPixmap)
 {
-	FALLBACK;
 }
 
 /*** Copy */
@@ -58,38 +93,194 @@ SWDoneSolid(PixmapPtr pPixmap)
 static Bool
 SWPrepareCopy(PixmapPtr pSrcPixmap, PixmapPtr pDstPixmap, int dx, int dy, int alu, Pixel planemask) 
 {
-	FALLBACK;
+	OMAPFBPtr ofb = PIXMAP_OMAPFB(pDstPixmap);
+
+	if (alu != GXcopy || !EXA_PM_IS_SOLID(&pDstPixmap->drawable, planemask))
+		FALLBACK;
+
+	if (pSrcPixmap->drawable.bitsPerPixel != pDstPixmap->drawable.bitsPerPixel
+	 || pDstPixmap->drawable.bitsPerPixel < 8)
+		FALLBACK;
+
+	ofb->exa_state.dst = SWPixmapAddress(ofb, pDstPixmap);
+	ofb->exa_state.dst_pitch = exaGetPixmapPitch(pDstPixmap);
+	ofb->exa_state.bpp = pDstPixmap->drawable.bitsPerPixel;
+	ofb->exa_state.src = SWPixmapAddress(ofb, pSrcPixmap);
+	ofb->exa_state.src_pitch = exaGetPixmapPitch(pSrcPixmap);
+	ofb->exa_state.xdir = dx;
+	ofb->exa_state.ydir = dy;
+
+	return TRUE;
 }
 
-static Bool
+static void
 SWCopy(PixmapPtr pDstPixmap, int srcX, int srcY, int dstX, int dstY, int width, int height) 
 {
-	FALLBACK;
+	OMAPFBExaStateRec *s = &PIXMAP_OMAPFB(pDstPixmap)->exa_state;
+	int cpp = s->bpp / 8;
+
+	blit_copy(width * cpp, height, s->src_pitch, s->dst_pitch,
+	          s->xdir, s->ydir,
+	          s->src + srcY * s->src_pitch + srcX * cpp,
+	          s->dst + dstY * s->dst_pitch + dstX * cpp);
 }
 
-static Bool
+static void
 SWDoneCopy(PixmapPtr pDstPixmap) 
 {
-	FALLBACK;
 }
 
 /*** Composite */
 
+typedef void (*SWCompositeFunc)(int w, int h, int src_pitch, int dst_pitch,
+                                uint8_t *src, uint8_t *dest);
+
+/* Unmasked operations with a kernel, everything else except a solid
+ * OVER through an a8 mask falls back
+ */
+static const struct {
+	int op;
+	unsigned int src_format;
+	unsigned int dst_format;
+	SWCompositeFunc func;
+} composite_kernels[] = {
+	{ PictOpOver, PICT_a8r8g8b8, PICT_r5g6b5, over_8888_0565 },
+	/* OVER of an opaque source is SRC */
+	{ PictOpOver, PICT_x8r8g8b8, PICT_r5g6b5, convert_8888_0565 },
+	{ PictOpAdd, PICT_a8, PICT_a8, add_8_8 },
+	{ PictOpSrc, PICT_a8r8g8b8, PICT_r5g6b5, convert_8888_0565 },
+	{ PictOpSrc, PICT_x8r8g8b8, PICT_r5g6b5, convert_8888_0565 },
+	{ PictOpSrc, PICT_r5g6b5, PICT_a8r8g8b8, convert_0565_8888 },
+	{ PictOpSrc, PICT_r5g6b5, PICT_x8r8g8b8, convert_0565_8888 },
+};
+#define COMPOSITE_KERNEL_COUNT \
+	(sizeof(composite_kernels) / sizeof(composite_kernels[0]))
+
+/* Only untransformed, non-repeating pictures map 1:1 to pixels */
+static Bool
+SWPictureIsPlain(PicturePtr pPicture)
+{
+	return pPicture->pDrawable != NULL
+	    && pPicture->transform == NULL
+	    && !pPicture->repeat
+	    && pPicture->alphaMap == NULL
+	    && !pPicture->componentAlpha;
+}
+
+/* OVER of a solid color through an a8 mask, which is how EXA draws glyph
+ * strings once it has added the glyphs from its glyph cache into a mask
+ */
+static Bool
+SWIsSolidOverMask(int op, PicturePtr pSrcPicture, PicturePtr pMaskPicture, PicturePtr pDstPicture)
+{
+	if (op != PictOpOver || !pMaskPicture)
+		return FALSE;
+
+	/* Clients mostly draw text from a solid fill source picture, which
+	 * has no drawable. Otherwise it must be a repeating 1x1 pixmap.
+	 */
+	if (!pSrcPicture->pDrawable) {
+		if (!pSrcPicture->pSourcePict || pSrcPicture->alphaMap
+		 || pSrcPicture->pSourcePict->type != SourcePictTypeSolidFill)
+			return FALSE;
+	} else {
+		if (!pSrcPicture->repeat
+		 || pSrcPicture->transform || pSrcPicture->alphaMap
+		 || pSrcPicture->pDrawable->width != 1
+		 || pSrcPicture->pDrawable->height != 1)
+			return FALSE;
+
+		if (pSrcPicture->format != PICT_a8r8g8b8
+		 && pSrcPicture->format != PICT_x8r8g8b8)
+			return FALSE;
+	}
+
+	return SWPictureIsPlain(pMaskPicture)
+	    && pMaskPicture->format == PICT_a8
+	    && pDstPicture->format == PICT_r5g6b5
+	    && !pDstPicture->alphaMap;
+}
+
+static SWCompositeFunc
+SWCompositeKernel(int op, PicturePtr pSrcPicture, PicturePtr pMaskPicture, PicturePtr pDstPicture)
+{
+	int i;
+
+	if (pMaskPicture || !SWPictureIsPlain(pSrcPicture)
+	 || pDstPicture->alphaMap)
+		return NULL;
+
+	for (i = 0; i < COMPOSITE_KERNEL_COUNT; i++) {
+		if (composite_kernels[i].op == op
+		 && composite_kernels[i].src_format == pSrcPicture->format
+		 && composite_kernels[i].dst_format == pDstPicture->format)
+			return composite_kernels[i].func;
+	}
+
+	return NULL;
+}
+
 static Bool
 SWCheckComposite(int op, PicturePtr pSrcPicture, PicturePtr pMaskPicture, PicturePtr pDstPicture) 
 {
-	FALLBACK;
+	if (!SWCompositeKernel(op, pSrcPicture, pMaskPicture, pDstPicture)
+	 && !SWIsSolidOverMask(op, pSrcPicture, pMaskPicture, pDstPicture))
+		FALLBACK;
+
+	return TRUE;
 }
 
 static Bool
 SWPrepareComposite(int op, PicturePtr pSrcPicture, PicturePtr pMaskPicture, PicturePtr pDstPicture, PixmapPtr pSrc, PixmapPtr pMask, PixmapPtr pDst)
 {
-	FALLBACK;
+	OMAPFBPtr ofb = PIXMAP_OMAPFB(pDst);
+	SWCompositeFunc func;
+
+	func = SWCompositeKernel(op, pSrcPicture, pMaskPicture, pDstPicture);
+	if (!func && !SWIsSolidOverMask(op, pSrcPicture, pMaskPicture, pDstPicture))
+		FALLBACK;
+
+	ofb->exa_state.composite = func;
+	ofb->exa_state.mask = NULL;
+	if (!func) {
+		if (!pSrcPicture->pDrawable) {
+			ofb->exa_state.solid = pSrcPicture->pSourcePict->solidFill.color;
+		} else {
+			ofb->exa_state.solid = *(CARD32 *)SWPixmapAddress(ofb, pSrc);
+			if (pSrcPicture->format == PICT_x8r8g8b8)
+				ofb->exa_state.solid |= 0xff000000;
+		}
+		ofb->exa_state.mask = SWPixmapAddress(ofb, pMask);
+		ofb->exa_state.mask_pitch = exaGetPixmapPitch(pMask);
+	}
+	ofb->exa_state.dst = SWPixmapAddress(ofb, pDst);
+	ofb->exa_state.dst_pitch = exaGetPixmapPitch(pDst);
+	ofb->exa_state.bpp = pDst->drawable.bitsPerPixel;
+	/* A solid fill source has no pixmap */
+	if (pSrc) {
+		ofb->exa_state.src = SWPixmapAddress(ofb, pSrc);
+		ofb->exa_state.src_pitch = exaGetPixmapPitch(pSrc);
+		ofb->exa_state.src_bpp = pSrc->drawable.bitsPerPixel;
+	}
+
+	return TRUE;
 }
 
 static void
 SWComposite(PixmapPtr pDst, int srcX, int srcY, int maskX, int maskY, int dstX, int dstY, int width, int height)
 {
+	OMAPFBExaStateRec *s = &PIXMAP_OMAPFB(pDst)->exa_state;
+
+	if (s->mask) {
+		over_n_8_0565(width, height, s->mask_pitch, s->dst_pitch,
+		              s->solid, s->mask + maskY * s->mask_pitch + maskX,
+		              s->dst + dstY * s->dst_pitch + dstX * 2);
+		return;
+	}
+
+	s->composite(width, height, s->src_pitch, s->dst_pitch,
+	             s->src + srcY * s->src_pitch + srcX * (s->src_bpp / 8),
+	             s->dst + dstY * s->dst_pitch + dstX * (s->bpp / 8));
 }
 
 static void
@@ -97,6 +288,42 @@ SWDoneComposite(PixmapPtr pDst)
 {
 }
 
+/*** Transfers */
+
+static Bool
+SWUploadToScreen(PixmapPtr pDst, int x, int y, int w, int h, char *src, int src_pitch)
+{
+	OMAPFBPtr ofb = PIXMAP_OMAPFB(pDst);
+	int pitch = exaGetPixmapPitch(pDst);
+	int cpp = pDst->drawable.bitsPerPixel / 8;
+
+	if (cpp == 0)
+		FALLBACK;
+
+	/* The areas never overlap, so a forward copy will do */
+	blit_copy(w * cpp, h, src_pitch, pitch, 1, 1, (uint8_t *)src,
+	          SWPixmapAddress(ofb, pDst) + y * pitch + x * cpp);
+
+	return TRUE;
+}
+
+static Bool
+SWDownloadFromScreen(PixmapPtr pSrc, int x, int y, int w, int h, char *dst, int dst_pitch)
+{
+	OMAPFBPtr ofb = PIXMAP_OMAPFB(pSrc);
+	int pitch = exaGetPixmapPitch(pSrc);
+	int cpp = pSrc->drawable.bitsPerPixel / 8;
+
+	if (cpp == 0)
+		FALLBACK;
+
+	readback_copy(w * cpp, h, pitch, dst_pitch,
+	              SWPixmapAddress(ofb, pSrc) + y * pitch + x * cpp,
+	              (uint8_t *)dst);
+
+	return TRUE;
+}
+
 /*** General */
 
 static void
@@ -124,10 +351,19 @@ Bool OMAPFBSetupExa(OMAPFBPtr ofb)
 	ofb->exa->memoryBase = ofb->fb;
 	ofb->exa->memorySize = ofb->mem_info.size;
 
-	/* TODO: maybe we could over-allocate the memory for the fb
-	 * to enable offscreen pixmaps? Dunno if it matters...
-	 */	
-	ofb->exa->offScreenBase = 0;
+	/* Anything past the visible screen is handed to EXA for offscreen
+	 * pixmaps, EXA evicts the least recently used ones when it runs out
+	 */
+	ofb->exa->offScreenBase = ofb->fixed_info.line_length
+	                        * ofb->state_info.yres_virtual;
+	if (ofb->exa->offScreenBase < ofb->exa->memorySize) {
+		ofb->exa->flags |= EXA_OFFSCREEN_PIXMAPS;
+		/* Keep pixmap lines aligned for the burst writes */
+		ofb->exa->pixmapOffsetAlign = 32;
+		ofb->exa->pixmapPitchAlign = 16;
+	} else {
+		ofb->exa->offScreenBase = ofb->exa->memorySize;
+	}
 
 	ofb->exa->maxX = ofb->state_info.xres;
 	ofb->exa->maxY = ofb->state_info.yres;
@@ -147,12 +383,16 @@ Bool OMAPFBSetupExa(OMAPFBPtr ofb)
 	EXA_FUNC(Composite);
 	EXA_FUNC(DoneComposite);
 
+	EXA_FUNC(UploadToScreen);
+	EXA_FUNC(DownloadFromScreen);
+
 	EXA_FUNC(WaitMarker);
 	EXA_FUNC(PrepareAccess);
 	EXA_FUNC(FinishAccess);
 	
-	/* TODO: we'd need a place to store EXA-specific data */
-	
+	/* The prepared operation is kept in ofb->exa_state */
+	memset(&ofb->exa_state, 0, sizeof(ofb->exa_state));
+
 	return TRUE;
 }
 